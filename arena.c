@@ -0,0 +1,81 @@
+#include "arena.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN (sizeof(void *) > sizeof(double) ? sizeof(void *) : sizeof(double))
+
+static ARENA_CHUNK *arena_new_chunk(ARENA *arena, size_t min_size) {
+    size_t size = ARENA_CHUNK_SIZE - sizeof(ARENA_CHUNK);
+    if (min_size > size) {
+        size = min_size;
+    }
+
+    ARENA_CHUNK *chunk = safe_malloc(sizeof(ARENA_CHUNK) + size);
+    chunk->prev        = arena->chunk;
+    chunk->size        = size;
+    chunk->used        = 0;
+
+    arena->chunk = chunk;
+    arena->chunks++;
+    arena->reserved += sizeof(ARENA_CHUNK) + size;
+    return chunk;
+}
+
+void *arena_alloc(ARENA *arena, size_t size) {
+    size_t       aligned = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    ARENA_CHUNK *chunk   = arena->chunk;
+
+    if (!chunk || chunk->size - chunk->used < aligned) {
+        // Oversized requests get a chunk of their own so that the current
+        // chunk keeps serving small objects.
+        if (chunk && aligned > ARENA_CHUNK_SIZE / 4) {
+            ARENA_CHUNK *big = safe_malloc(sizeof(ARENA_CHUNK) + aligned);
+            big->size        = aligned;
+            big->used        = aligned;
+            big->prev        = chunk->prev;
+            chunk->prev      = big;
+
+            arena->chunks++;
+            arena->reserved += sizeof(ARENA_CHUNK) + aligned;
+            arena->bytes += size;
+            arena->objects++;
+            return big->data;
+        }
+        chunk = arena_new_chunk(arena, aligned);
+    }
+
+    void *ptr = chunk->data + chunk->used;
+    chunk->used += aligned;
+
+    arena->bytes += size;
+    arena->objects++;
+    return ptr;
+}
+
+void *arena_calloc(ARENA *arena, size_t count, size_t size) {
+    void *ptr = arena_alloc(arena, count * size);
+    memset(ptr, 0, count * size);
+    return ptr;
+}
+
+char *arena_strndup(ARENA *arena, const char *str, size_t len) {
+    char *dup = arena_alloc(arena, len + 1);
+    memcpy(dup, str, len);
+    dup[len] = '\0';
+    return dup;
+}
+
+char *arena_strdup(ARENA *arena, const char *str) {
+    return arena_strndup(arena, str, strlen(str));
+}
+
+void arena_free(ARENA *arena) {
+    ARENA_CHUNK *chunk = arena->chunk;
+    while (chunk) {
+        ARENA_CHUNK *prev = chunk->prev;
+        free(chunk);
+        chunk = prev;
+    }
+    memset(arena, 0, sizeof(ARENA));
+}
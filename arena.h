@@ -0,0 +1,35 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+typedef struct ARENA_CHUNK ARENA_CHUNK;
+struct ARENA_CHUNK {
+    ARENA_CHUNK *prev;
+    size_t       size;
+    size_t       used;
+    char         data[];
+};
+
+// Region allocator: every allocation lives until arena_free() releases the
+// whole region at once.
+typedef struct ARENA ARENA;
+struct ARENA {
+    ARENA_CHUNK *chunk;
+
+    // Statistics
+    size_t bytes;    // Bytes handed out
+    size_t objects;  // Allocations handed out
+    size_t chunks;   // Chunks obtained from malloc
+    size_t reserved; // Bytes obtained from malloc
+};
+
+void *arena_alloc(ARENA *arena, size_t size);
+void *arena_calloc(ARENA *arena, size_t count, size_t size);
+char *arena_strndup(ARENA *arena, const char *str, size_t len);
+char *arena_strdup(ARENA *arena, const char *str);
+void  arena_free(ARENA *arena);
+
+#endif
@@ -0,0 +1,532 @@
+#include "cache.h"
+#include "config.h"
+#include "logger.h"
+#include "utils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Cache file being built by md_cache_save()
+typedef struct {
+    BUFFER   nodes;
+    BUFFER   slots;
+    BUFFER   codes;
+    BUFFER   envs;
+    BUFFER   deps;
+    BUFFER   strings;
+    uint32_t node_count;
+    uint32_t code_count;
+    uint32_t env_count;
+    uint32_t dep_count;
+    uint32_t index_count;
+} MD_CACHE_WRITER;
+
+// Word at a time hash of the markdown content, catches changes which keep
+// the size and the modification time
+static uint64_t md_cache_hash(const char *data, size_t size) {
+    uint64_t hash = 0x9E3779B97F4A7C15ull ^ size;
+    size_t   i    = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 32;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, data + i, size - i);
+    hash = (hash ^ tail) * 0xC4CEB9FE1A85EC53ull;
+    return hash ^ (hash >> 29);
+}
+
+static void md_cache_mkdir(const char *path) {
+    if (mkdir(path, 0700) != 0 && errno != EEXIST) {
+        info("Cannot create %s\n", path);
+    }
+}
+
+// Directory of the cr cache files, $XDG_CACHE_HOME/cr or ~/.cache/cr,
+// creating it when asked to
+int md_cache_dir(char *dir, size_t size, int create) {
+    const char *xdg  = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+
+    if (xdg && xdg[0] == '/') {
+        snprintf(dir, size, "%s", xdg);
+    } else if (home && home[0]) {
+        snprintf(dir, size, "%s/.cache", home);
+    } else {
+        return -1;
+    }
+    if (create) {
+        md_cache_mkdir(dir);
+    }
+    strncat(dir, "/cr", size - strlen(dir) - 1);
+    if (create) {
+        md_cache_mkdir(dir);
+    }
+    return 0;
+}
+
+// Cache file of the markdown file at real_path, creating its directory
+// when asked to
+static int md_cache_path(const char *real_path, char *path, size_t size, int create) {
+    char dir[PATH_MAX];
+    if (md_cache_dir(dir, sizeof(dir), create) != 0) {
+        return -1;
+    }
+
+    // FNV-1a of the path names the file, the header holds the full path
+    uint64_t hash = 14695981039346656037ull;
+    for (const char *p = real_path; *p; p++) {
+        hash ^= (unsigned char)*p;
+        hash *= 1099511628211ull;
+    }
+    int len = snprintf(path, size, "%s/%016llx%s.ast", dir, (unsigned long long)hash, config.all ? "-all" : "");
+    return len < 0 || (size_t)len >= size ? -1 : 0;
+}
+
+static int md_cache_header_valid(const MD_CACHE_HEADER *header, size_t size, const char *real_path) {
+    if (size < sizeof(MD_CACHE_HEADER) || header->magic != MD_CACHE_MAGIC || header->version != MD_CACHE_VERSION) {
+        return 0;
+    }
+    if (header->flags != (config.all ? MD_CACHE_ALL : 0)) {
+        return 0;
+    }
+
+    uint64_t expected = sizeof(MD_CACHE_HEADER) + (uint64_t)header->node_count * sizeof(MD_CACHE_NODE) +
+                        (uint64_t)header->code_count * sizeof(MD_CACHE_CODE) +
+                        (uint64_t)header->env_count * sizeof(MD_CACHE_ENV) +
+                        (uint64_t)header->dep_count * sizeof(MD_CACHE_TEXT) +
+                        (uint64_t)header->index_capacity * sizeof(int32_t) + header->strings_size;
+    if (expected != size || header->strings_size == 0 || (header->index_capacity & (header->index_capacity - 1)) ||
+        header->index_count > header->index_capacity) {
+        return 0;
+    }
+
+    const char *strings = (const char *)header + size - header->strings_size;
+    return strings[header->strings_size - 1] == '\0' && header->path < header->strings_size &&
+           strcmp(strings + header->path, real_path) == 0;
+}
+
+// Whether the markdown file is unchanged by its stat fields alone, so a hit
+// does not read the whole file. Like git's racily clean entries, a file
+// changed no earlier than the cache was written may have changed again
+// within the same timestamp and is not trusted.
+static int md_cache_stat_fresh(const MD_CACHE_HEADER *header, const struct stat *st, const struct stat *cache_st) {
+    if (header->file_size != (uint64_t)st->st_size || header->mtime_sec != (uint64_t)st->st_mtim.tv_sec ||
+        header->mtime_nsec != (uint64_t)st->st_mtim.tv_nsec || header->ctime_sec != (uint64_t)st->st_ctim.tv_sec ||
+        header->ctime_nsec != (uint64_t)st->st_ctim.tv_nsec || header->inode != (uint64_t)st->st_ino ||
+        header->device != (uint64_t)st->st_dev) {
+        return 0;
+    }
+    return st->st_mtim.tv_sec < cache_st->st_mtim.tv_sec ||
+           (st->st_mtim.tv_sec == cache_st->st_mtim.tv_sec && st->st_mtim.tv_nsec < cache_st->st_mtim.tv_nsec);
+}
+
+// Text of the string pool, NULL ptr when it is out of bounds
+static MD_TEXT md_cache_text(const MD_CACHE_HEADER *header, const char *strings, MD_CACHE_TEXT text, int *ok) {
+    if (text.offset == MD_CACHE_NONE) {
+        return (MD_TEXT){0};
+    }
+    if ((uint64_t)text.offset + text.size >= header->strings_size || strings[text.offset + text.size] != '\0') {
+        *ok = 0;
+        return (MD_TEXT){0};
+    }
+    return (MD_TEXT){.ptr = strings + text.offset, .size = text.size, .is_cstr = 1};
+}
+
+static int md_cache_index_valid(int32_t index, uint32_t count) {
+    return index >= -1 && index < (int64_t)count;
+}
+
+// Link the nodes of the mapped cache file, their text stays in the mapping
+static int md_cache_build(MD_DOCUMENT *doc, const MD_CACHE_HEADER *header) {
+    const MD_CACHE_NODE *node_records = (const MD_CACHE_NODE *)(header + 1);
+    const MD_CACHE_CODE *code_records = (const MD_CACHE_CODE *)(node_records + header->node_count);
+    const MD_CACHE_ENV  *env_records  = (const MD_CACHE_ENV *)(code_records + header->code_count);
+    const MD_CACHE_TEXT *dep_records  = (const MD_CACHE_TEXT *)(env_records + header->env_count);
+    const int32_t       *slots        = (const int32_t *)(dep_records + header->dep_count);
+    const char          *strings      = (const char *)(slots + header->index_capacity);
+
+    MD_NODE    *nodes = arena_calloc(&doc->arena, header->node_count, sizeof(MD_NODE));
+    CODE_BLOCK *codes = arena_calloc(&doc->arena, header->code_count, sizeof(CODE_BLOCK));
+    ENV_ENTRY  *envs  = arena_calloc(&doc->arena, header->env_count, sizeof(ENV_ENTRY));
+    DEPENDENCY *deps  = arena_calloc(&doc->arena, header->dep_count, sizeof(DEPENDENCY));
+    int         ok    = 1;
+
+    for (uint32_t i = 0; i < header->code_count; i++) {
+        codes[i].info    = md_cache_text(header, strings, code_records[i].info, &ok);
+        codes[i].content = md_cache_text(header, strings, code_records[i].content, &ok);
+    }
+    for (uint32_t i = 0; i < header->env_count; i++) {
+        envs[i].key   = md_cache_text(header, strings, env_records[i].key, &ok);
+        envs[i].value = md_cache_text(header, strings, env_records[i].value, &ok);
+    }
+    for (uint32_t i = 0; i < header->dep_count; i++) {
+        deps[i].heading = md_cache_text(header, strings, dep_records[i], &ok);
+    }
+
+    for (uint32_t i = 0; i < header->node_count && ok; i++) {
+        const MD_CACHE_NODE *record = &node_records[i];
+        MD_NODE             *node   = &nodes[i];
+
+        if (!md_cache_index_valid(record->parent, header->node_count) ||
+            !md_cache_index_valid(record->next, header->node_count) ||
+            !md_cache_index_valid(record->child, header->node_count) ||
+            record->parent >= (int32_t)i || (record->next >= 0 && record->next <= (int32_t)i) ||
+            (record->child >= 0 && record->child != (int32_t)i + 1) ||
+            (uint64_t)record->code_first + record->code_count > header->code_count ||
+            (uint64_t)record->env_first + record->env_count > header->env_count ||
+            (uint64_t)record->dep_first + record->dep_count > header->dep_count) {
+            return -1;
+        }
+
+        node->level       = record->level;
+        node->text        = md_cache_text(header, strings, record->text, &ok);
+        node->description = md_cache_text(header, strings, record->description, &ok);
+        node->parent      = record->parent >= 0 ? &nodes[record->parent] : NULL;
+        node->next        = record->next >= 0 ? &nodes[record->next] : NULL;
+        node->child       = record->child >= 0 ? &nodes[record->child] : NULL;
+
+        if (record->code_count) {
+            node->code_block      = &codes[record->code_first];
+            node->code_block_tail = &codes[record->code_first + record->code_count - 1];
+            for (uint32_t j = 0; j + 1 < record->code_count; j++) {
+                codes[record->code_first + j].next = &codes[record->code_first + j + 1];
+            }
+        }
+        if (record->env_count) {
+            node->env_entry      = &envs[record->env_first];
+            node->env_entry_tail = &envs[record->env_first + record->env_count - 1];
+            for (uint32_t j = 0; j + 1 < record->env_count; j++) {
+                envs[record->env_first + j].next = &envs[record->env_first + j + 1];
+            }
+        }
+        if (record->dep_count) {
+            node->depends      = &deps[record->dep_first];
+            node->depends_tail = &deps[record->dep_first + record->dep_count - 1];
+            for (uint32_t j = 0; j + 1 < record->dep_count; j++) {
+                deps[record->dep_first + j].next = &deps[record->dep_first + j + 1];
+            }
+        }
+    }
+
+    if (header->index_capacity) {
+        doc->index = calloc(header->index_capacity, sizeof(MD_NODE *));
+        if (!doc->index) {
+            return -1;
+        }
+        doc->index_capacity = header->index_capacity;
+        doc->index_count    = header->index_count;
+        for (uint32_t i = 0; i < header->index_capacity; i++) {
+            if (!md_cache_index_valid(slots[i], header->node_count)) {
+                return -1;
+            }
+            doc->index[i] = slots[i] >= 0 ? &nodes[slots[i]] : NULL;
+        }
+    }
+
+    if (!ok) {
+        return -1;
+    }
+    doc->root = header->node_count ? &nodes[0] : NULL;
+    md_build_nodes(doc);
+    return 0;
+}
+
+// Map the cache file of file_path when its header belongs to the file, with
+// the stat of the markdown file in st and of the cache file in cache_st.
+// Returns NULL on a miss.
+static const MD_CACHE_HEADER *md_cache_map(const char *file_path, int populate, struct stat *st, struct stat *cache_st, char *cache_path) {
+    char real_path[PATH_MAX];
+    if (!realpath(file_path, real_path) || stat(real_path, st) != 0 || !S_ISREG(st->st_mode) ||
+        md_cache_path(real_path, cache_path, PATH_MAX, 0) != 0) {
+        return NULL;
+    }
+
+    int fd = open(cache_path, O_RDONLY);
+    if (fd < 0) {
+        info("Cache miss: %s\n", cache_path);
+        return NULL;
+    }
+    void *map = MAP_FAILED;
+    if (fstat(fd, cache_st) == 0 && cache_st->st_size >= (off_t)sizeof(MD_CACHE_HEADER)) {
+        int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+        if (populate) {
+            flags |= MAP_POPULATE;
+        }
+#endif
+        map = mmap(NULL, cache_st->st_size, PROT_READ, flags, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        info("Cache unreadable: %s\n", cache_path);
+        return NULL;
+    }
+    if (!md_cache_header_valid(map, cache_st->st_size, real_path)) {
+        info("Cache stale: %s\n", cache_path);
+        munmap(map, cache_st->st_size);
+        return NULL;
+    }
+    return map;
+}
+
+// Whether the cache of file_path is up to date by the stat fields alone.
+// Touches the header and the path only, so it costs the same for any size.
+int md_cache_fresh(const char *file_path) {
+    char                   cache_path[PATH_MAX];
+    struct stat            st, cache_st;
+    const MD_CACHE_HEADER *header = md_cache_map(file_path, 0, &st, &cache_st, cache_path);
+    if (!header) {
+        return 0;
+    }
+    int fresh = md_cache_stat_fresh(header, &st, &cache_st);
+    munmap((void *)header, cache_st.st_size);
+    return fresh;
+}
+
+// Load the cached document of file_path. Returns NULL when there is no
+// cache file or it does not match the current content of the file.
+MD_DOCUMENT *md_cache_load(const char *file_path) {
+    char                   cache_path[PATH_MAX];
+    struct stat            st, cache_st;
+    const MD_CACHE_HEADER *header = md_cache_map(file_path, 1, &st, &cache_st, cache_path);
+    if (!header) {
+        return NULL;
+    }
+    void *map = (void *)header;
+    if (!md_cache_stat_fresh(header, &st, &cache_st)) {
+        // A touched or copied file whose content is the same still hits
+        MD_SOURCE source;
+        int       same = md_source_load(&source, file_path, 1) == 0 && md_cache_hash(source.data, source.size) == header->content_hash;
+        md_source_free(&source);
+        if (!same) {
+            info("Cache stale: %s\n", cache_path);
+            munmap(map, cache_st.st_size);
+            return NULL;
+        }
+    }
+
+    MD_DOCUMENT *doc = safe_malloc(sizeof(MD_DOCUMENT));
+    memset(doc, 0, sizeof(MD_DOCUMENT));
+    doc->source = (MD_SOURCE){.data = map, .size = cache_st.st_size, .is_mapped = 1};
+
+    if (md_cache_build(doc, header) != 0) {
+        info("Cache corrupt: %s\n", cache_path);
+        md_free_document(doc);
+        return NULL;
+    }
+    info("Cache hit: %s, %u nodes\n", cache_path, header->node_count);
+    return doc;
+}
+
+static MD_CACHE_TEXT md_cache_add_text(MD_CACHE_WRITER *w, const MD_TEXT *text) {
+    if (!text->ptr) {
+        return (MD_CACHE_TEXT){.offset = MD_CACHE_NONE};
+    }
+    MD_CACHE_TEXT cached = {.offset = w->strings.size, .size = text->size};
+    buffer_append(&w->strings, text->ptr, text->size);
+    buffer_append(&w->strings, "", 1);
+    return cached;
+}
+
+// Append the nodes, which doc->nodes holds in document order
+static void md_cache_add_nodes(MD_CACHE_WRITER *w, MD_DOCUMENT *doc) {
+    MD_NODES *nodes = &doc->nodes;
+
+    for (int i = 0; i < nodes->count; i++) {
+        MD_NODE      *node   = nodes->node[i];
+        MD_CACHE_NODE record = {
+            .level       = nodes->level[i],
+            .parent      = nodes->parent[i],
+            .next        = nodes->next_sibling[i],
+            .child       = nodes->first_child[i],
+            .text        = md_cache_add_text(w, &node->text),
+            .description = md_cache_add_text(w, &node->description),
+            .code_first  = w->code_count,
+            .env_first   = w->env_count,
+            .dep_first   = w->dep_count,
+        };
+
+        for (CODE_BLOCK *block = node->code_block; block; block = block->next) {
+            MD_CACHE_CODE code = {md_cache_add_text(w, &block->info), md_cache_add_text(w, &block->content)};
+            buffer_append(&w->codes, (const char *)&code, sizeof(code));
+            w->code_count++;
+            record.code_count++;
+        }
+        for (ENV_ENTRY *env = node->env_entry; env; env = env->next) {
+            MD_CACHE_ENV entry = {md_cache_add_text(w, &env->key), md_cache_add_text(w, &env->value)};
+            buffer_append(&w->envs, (const char *)&entry, sizeof(entry));
+            w->env_count++;
+            record.env_count++;
+        }
+        for (DEPENDENCY *dep = node->depends; dep; dep = dep->next) {
+            MD_CACHE_TEXT heading = md_cache_add_text(w, &dep->heading);
+            buffer_append(&w->deps, (const char *)&heading, sizeof(heading));
+            w->dep_count++;
+            record.dep_count++;
+        }
+        buffer_append(&w->nodes, (const char *)&record, sizeof(record));
+        w->node_count++;
+    }
+}
+
+// Heading index slots over the numbered nodes, inserted in document order
+// like md_index_insert() does
+static void md_cache_add_index(MD_CACHE_WRITER *w, size_t capacity) {
+    MD_CACHE_NODE *records = (MD_CACHE_NODE *)w->nodes.data;
+    size_t         mask    = capacity - 1;
+
+    for (size_t i = 0; i < capacity; i++) {
+        int32_t empty = -1;
+        buffer_append(&w->slots, (const char *)&empty, sizeof(empty));
+    }
+    int32_t *slots = (int32_t *)w->slots.data;
+
+    for (uint32_t i = 0; i < w->node_count; i++) {
+        if (records[i].text.offset == MD_CACHE_NONE) {
+            continue;
+        }
+        const char *text = w->strings.data + records[i].text.offset;
+        size_t      size = records[i].text.size;
+        size_t      slot = md_index_hash(text, size) & mask;
+        while (slots[slot] >= 0) {
+            MD_CACHE_NODE *other = &records[slots[slot]];
+            if (other->text.size == size && strncasecmp(w->strings.data + other->text.offset, text, size) == 0) {
+                break;
+            }
+            slot = (slot + 1) & mask;
+        }
+        if (slots[slot] < 0) {
+            slots[slot] = i;
+            w->index_count++;
+        }
+    }
+}
+
+static int md_cache_write(int fd, const void *data, size_t size) {
+    const char *p = data;
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+// Save the fully parsed doc of file_path. The file is written under a
+// temporary name and renamed into place, so concurrent readers and writers
+// only ever see complete cache files. The header records the file as it was
+// when it was loaded, so a change made since is not taken for fresh.
+void md_cache_save(MD_DOCUMENT *doc, const char *file_path) {
+    char        real_path[PATH_MAX];
+    char        cache_path[PATH_MAX];
+    char        temp_path[PATH_MAX + 8];
+    struct stat st = doc->source.st;
+    if (doc->is_partial || !realpath(file_path, real_path) || !S_ISREG(st.st_mode) ||
+        md_cache_path(real_path, cache_path, sizeof(cache_path), 1) != 0) {
+        return;
+    }
+
+    MD_CACHE_WRITER w = {0};
+    MD_TEXT         path = {.ptr = real_path, .size = strlen(real_path)};
+    MD_CACHE_HEADER header = {
+        .magic        = MD_CACHE_MAGIC,
+        .version      = MD_CACHE_VERSION,
+        .flags        = config.all ? MD_CACHE_ALL : 0,
+        .path         = md_cache_add_text(&w, &path).offset,
+        .file_size    = st.st_size,
+        .mtime_sec    = st.st_mtim.tv_sec,
+        .mtime_nsec   = st.st_mtim.tv_nsec,
+        .ctime_sec    = st.st_ctim.tv_sec,
+        .ctime_nsec   = st.st_ctim.tv_nsec,
+        .inode        = st.st_ino,
+        .device       = st.st_dev,
+        .content_hash = md_cache_hash(doc->source.data, doc->source.size),
+    };
+    md_cache_add_nodes(&w, doc);
+    md_cache_add_index(&w, doc->index_capacity);
+    header.node_count     = w.node_count;
+    header.code_count     = w.code_count;
+    header.env_count      = w.env_count;
+    header.dep_count      = w.dep_count;
+    header.index_capacity = doc->index_capacity;
+    header.index_count    = w.index_count;
+    header.strings_size   = w.strings.size;
+
+    int fd = -1;
+    if (w.strings.size < MD_CACHE_NONE) {
+        snprintf(temp_path, sizeof(temp_path), "%s.XXXXXX", cache_path);
+        fd = mkstemp(temp_path);
+    }
+    if (fd >= 0) {
+        int ret = md_cache_write(fd, &header, sizeof(header));
+        ret |= md_cache_write(fd, w.nodes.data, w.nodes.size);
+        ret |= md_cache_write(fd, w.codes.data, w.codes.size);
+        ret |= md_cache_write(fd, w.envs.data, w.envs.size);
+        ret |= md_cache_write(fd, w.deps.data, w.deps.size);
+        ret |= md_cache_write(fd, w.slots.data, w.slots.size);
+        ret |= md_cache_write(fd, w.strings.data, w.strings.size);
+        ret |= close(fd);
+        if (ret == 0 && rename(temp_path, cache_path) == 0) {
+            info("Saved cache: %s\n", cache_path);
+        } else {
+            info("Cannot write cache: %s\n", cache_path);
+            unlink(temp_path);
+        }
+    }
+
+    buffer_free(&w.nodes);
+    buffer_free(&w.slots);
+    buffer_free(&w.codes);
+    buffer_free(&w.envs);
+    buffer_free(&w.deps);
+    buffer_free(&w.strings);
+}
+
+// Parse file_path whole and save its cache from a detached process, for a
+// run which only parsed the section it needs and does not wait for the rest
+void md_cache_save_background(const char *file_path) {
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0) {
+        info("Cannot fork to save the cache\n");
+        return;
+    }
+    if (pid > 0) {
+        waitpid(pid, NULL, 0);
+        return;
+    }
+
+    // The grandchild is reparented, so nothing waits for it, and it keeps
+    // none of our output open for whoever reads it
+    if (fork() != 0) {
+        _exit(0);
+    }
+    int null = open("/dev/null", O_RDWR);
+    if (null >= 0) {
+        dup2(null, STDIN_FILENO);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+    }
+    MD_DOCUMENT *doc = md_parse_file((char *)file_path, NULL);
+    if (doc) {
+        md_cache_save(doc, file_path);
+    }
+    _exit(0);
+}
@@ -0,0 +1,90 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "markdown.h"
+#include <stdint.h>
+
+// Parsed documents are cached under $XDG_CACHE_HOME/cr, one file per
+// markdown file. A cache file is a header followed by flat arrays which
+// refer to each other by index and to text by offset into a string pool,
+// so it is used in place from a read-only mapping.
+//
+//     MD_CACHE_HEADER | MD_CACHE_NODE[] | MD_CACHE_CODE[] | MD_CACHE_ENV[] | MD_CACHE_TEXT[] | index | strings
+//
+// The MD_CACHE_TEXT array holds the headings of the depends tables.
+//
+// The heading index is stored as its hash table slots, each a node index or
+// -1, so loading it does not hash anything.
+#define MD_CACHE_MAGIC   0x31435243 // "CRC1"
+#define MD_CACHE_VERSION 3
+
+// Header flags
+#define MD_CACHE_ALL 0x1 // Code blocks of all languages were kept (--all)
+
+#define MD_CACHE_NONE ((uint32_t)-1)
+
+// Text in the string pool, NUL-terminated. offset is MD_CACHE_NONE for no text.
+typedef struct {
+    uint32_t offset;
+    uint32_t size;
+} MD_CACHE_TEXT;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t flags;
+    uint32_t path; // Resolved path of the markdown file, in the string pool
+
+    // Markdown file the cache was built from
+    uint64_t file_size;
+    uint64_t mtime_sec;
+    uint64_t mtime_nsec;
+    uint64_t ctime_sec;
+    uint64_t ctime_nsec;
+    uint64_t inode;
+    uint64_t device;
+    uint64_t content_hash;
+
+    uint32_t node_count;
+    uint32_t code_count;
+    uint32_t env_count;
+    uint32_t dep_count;
+    uint32_t index_capacity;
+    uint32_t index_count;
+    uint32_t strings_size;
+} MD_CACHE_HEADER;
+
+// Heading nodes in document order, code blocks, env entries and dependencies
+// of a node are consecutive.
+typedef struct {
+    int32_t       level;
+    int32_t       parent; // Node indexes, -1 for none
+    int32_t       next;
+    int32_t       child;
+    MD_CACHE_TEXT text;
+    MD_CACHE_TEXT description;
+    uint32_t      code_first;
+    uint32_t      code_count;
+    uint32_t      env_first;
+    uint32_t      env_count;
+    uint32_t      dep_first;
+    uint32_t      dep_count;
+} MD_CACHE_NODE;
+
+typedef struct {
+    MD_CACHE_TEXT info;
+    MD_CACHE_TEXT content;
+} MD_CACHE_CODE;
+
+typedef struct {
+    MD_CACHE_TEXT key;
+    MD_CACHE_TEXT value;
+} MD_CACHE_ENV;
+
+MD_DOCUMENT *md_cache_load(const char *file_path);
+void         md_cache_save(MD_DOCUMENT *doc, const char *file_path);
+void         md_cache_save_background(const char *file_path);
+int          md_cache_fresh(const char *file_path);
+int          md_cache_dir(char *dir, size_t size, int create);
+
+#endif
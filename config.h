@@ -12,9 +12,13 @@ struct config {
     int markdown;
     int code;
     int all;
+    int no_cache;
+    int force;
 
     // Options
     char *file_path;
+    int   jobs; // Headings run at once, 0 when running one heading
+
 };
 
 #endif
\ No newline at end of file
@@ -1,7 +1,16 @@
 #include "executor.h"
 #include "logger.h"
+#include "stamp.h"
 #include "utils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <spawn.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
@@ -37,11 +46,11 @@ static const struct language_config language_configs[] = {
     {"batch", cmd_args, 3},
     {"powershell", powershell_args, 3}};
 
-const struct language_config *get_language_config(const char *lang) {
+const struct language_config *get_language_config(const char *lang, size_t len) {
     const struct language_config *config = NULL;
     // Find language configuration
     for (size_t i = 0; i < sizeof(language_configs) / sizeof(language_configs[0]); i++) {
-        if (strcasecmp(language_configs[i].name, lang) == 0) {
+        if (strlen(language_configs[i].name) == len && strncasecmp(language_configs[i].name, lang, len) == 0) {
             config = &language_configs[i];
             break;
         }
@@ -49,111 +58,592 @@ const struct language_config *get_language_config(const char *lang) {
     return config;
 }
 
-// Execute code blocks for a given node
-int execute_node(MD_NODE *node, char **args, int num_args) {
-    int exit_code;
-    info("Executing node: %s\n", node->text);
-
-    info("Setting up environment variables\n");
-    // First collect all nodes from root to target in a stack
-    info("Env stack size: %d\n", node->level);
-    MD_NODE *stack[node->level];
+extern char **environ;
+
+// Interpreters of the language configs found in PATH, each looked up once
+// per run unless a heading sets another PATH
+static struct {
+    char *program;
+    char *search_path; // PATH it was found in
+} program_paths[sizeof(language_configs) / sizeof(language_configs[0])];
+
+// Value of key in envp, NULL when it is not set
+static const char *envp_get(char **envp, const char *key) {
+    size_t len = strlen(key);
+    for (char **entry = envp; *entry; entry++) {
+        if (strncmp(*entry, key, len) == 0 && (*entry)[len] == '=') {
+            return *entry + len + 1;
+        }
+    }
+    return NULL;
+}
+
+// Full path of the program of the language config, searched in the PATH of
+// envp like execvp() does. NULL when it is not found.
+static const char *find_program(const struct language_config *config, const char *name, char **envp) {
+    const char *path = envp_get(envp, "PATH");
+    if (!path) {
+        path = "/usr/local/bin:/bin:/usr/bin";
+    }
+    size_t index = config - language_configs;
+    if (program_paths[index].program && strcmp(program_paths[index].search_path, path) == 0) {
+        return program_paths[index].program;
+    }
+
+    char *program = NULL;
+    if (strchr(name, '/')) {
+        program = strdup(name);
+    }
+    for (const char *dir = path; !program && *dir;) {
+        // An empty entry is the current directory
+        size_t      len = strcspn(dir, ":");
+        char        candidate[PATH_MAX];
+        struct stat st;
+        int         n = snprintf(candidate, sizeof(candidate), "%.*s/%s", (int)len, len ? dir : ".", name);
+        if (n > 0 && (size_t)n < sizeof(candidate) && stat(candidate, &st) == 0 && S_ISREG(st.st_mode) &&
+            access(candidate, X_OK) == 0) {
+            info("Found %s at %s\n", name, candidate);
+            program = strdup(candidate);
+        }
+        dir += len + (dir[len] == ':');
+    }
+    if (program) {
+        free(program_paths[index].program);
+        free(program_paths[index].search_path);
+        program_paths[index].program     = program;
+        program_paths[index].search_path = strdup(path);
+    }
+    return program;
+}
+
+// FNV-1a of an env key
+static size_t env_key_hash(const char *key, size_t len) {
+    size_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)key[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Key of an entry of the envp being built
+typedef struct {
+    const char *ptr;
+    size_t      len;
+} ENV_KEY;
+
+// Slot of the key in the open addressing table over keys, either the one
+// holding it or the empty one where it goes
+static size_t env_slot(int *slots, size_t mask, ENV_KEY *keys, const char *key, size_t len) {
+    size_t slot = env_key_hash(key, len) & mask;
+    while (slots[slot] >= 0) {
+        ENV_KEY *other = &keys[slots[slot]];
+        if (other->len == len && memcmp(other->ptr, key, len) == 0) {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+// Environment of the code blocks of node: ours with the env tables from the
+// root down to node applied, later entries overriding earlier ones and rows
+// without a value unsetting. Built on first use and kept in the node, so
+// running the heading again or from several jobs reuses it. Our own
+// environment must not change after that.
+char **node_envp(MD_DOCUMENT *doc, MD_NODE *node) {
+    if (node->envp) {
+        return node->envp;
+    }
+
+    size_t count = 0;
+    while (environ[count]) {
+        count++;
+    }
+    int depth = 0;
+    for (MD_NODE *current = node; current; current = current->parent) {
+        depth++;
+        for (ENV_ENTRY *env = current->env_entry; env; env = env->next) {
+            count++;
+        }
+    }
+
+    size_t capacity = 16;
+    while (capacity < 2 * count) {
+        capacity *= 2;
+    }
+    char   **entries = arena_alloc(&doc->arena, (count + 1) * sizeof(char *));
+    ENV_KEY *keys    = safe_malloc((count + 1) * sizeof(ENV_KEY));
+    int     *slots   = safe_malloc(capacity * sizeof(int));
+    size_t   size    = 0;
+    for (size_t i = 0; i < capacity; i++) {
+        slots[i] = -1;
+    }
+
+    // Ours first, the first of duplicate keys wins like in getenv()
+    for (char **entry = environ; *entry; entry++) {
+        size_t len  = strcspn(*entry, "=");
+        size_t slot = env_slot(slots, capacity - 1, keys, *entry, len);
+        if (slots[slot] < 0 && (*entry)[len] == '=') {
+            slots[slot]     = size;
+            keys[size]      = (ENV_KEY){*entry, len};
+            entries[size++] = *entry;
+        }
+    }
+
+    // Then the env tables from the root down, unset entries are left NULL
+    MD_NODE *stack[depth];
     int      stack_size = 0;
-    MD_NODE *current    = node;
-    while (current) {
+    for (MD_NODE *current = node; current; current = current->parent) {
         stack[stack_size++] = current;
-        current             = current->parent;
     }
-
-    // Now set environment variables from root to leaf (reverse order of stack)
     for (int i = stack_size - 1; i >= 0; i--) {
-        ENV_ENTRY *env = stack[i]->env_entry;
-        while (env) {
-            if (env->value) {
-                setenv(env->key, env->value, 1);
-                info("Setenv %s=%s\n", env->key, env->value);
+        for (ENV_ENTRY *env = stack[i]->env_entry; env; env = env->next) {
+            if (!env->key.ptr || !env->key.size || memchr(env->key.ptr, '=', env->key.size) || stamp_key(&env->key)) {
+                continue; // Row without a key, not a valid name, or for cr only
+            }
+            char  *entry = NULL;
+            size_t slot  = env_slot(slots, capacity - 1, keys, env->key.ptr, env->key.size);
+            if (env->value.ptr) {
+                entry = arena_alloc(&doc->arena, env->key.size + env->value.size + 2);
+                memcpy(entry, env->key.ptr, env->key.size);
+                entry[env->key.size] = '=';
+                memcpy(entry + env->key.size + 1, env->value.ptr, env->value.size);
+                entry[env->key.size + env->value.size + 1] = '\0';
+                info("Env %s\n", entry);
             } else {
-                unsetenv(env->key);
-                info("Unsetenv %s\n", env->key);
+                info("Env unset %.*s\n", MD_TEXT_ARG(env->key));
             }
 
-            env = env->next;
+            if (slots[slot] >= 0) {
+                entries[slots[slot]] = entry;
+            } else if (entry) {
+                slots[slot]     = size;
+                keys[size]      = (ENV_KEY){env->key.ptr, env->key.size};
+                entries[size++] = entry;
+            }
         }
     }
+    free(keys);
+    free(slots);
 
-    CODE_BLOCK *block = node->code_block;
-    while (block) {
-        if (block->info && block->content) {
-            const char                   *lang   = block->info;
-            const struct language_config *config = get_language_config(lang);
+    // Drop the unset entries. Their keys stay in the table until here, so a
+    // key unset and set again by a later row takes its place again.
+    size_t kept = 0;
+    for (size_t i = 0; i < size; i++) {
+        if (entries[i]) {
+            entries[kept++] = entries[i];
+        }
+    }
+    entries[kept] = NULL;
+    node->envp    = entries;
+    return entries;
+}
+
+// Wait for the child, its exit code or 128 and the signal that killed it
+static int wait_exit_code(pid_t pid) {
+    int status;
+    while (waitpid(pid, &status, 0) == -1) {
+        if (errno != EINTR) {
+            perror("waitpid failed");
+            return 1;
+        }
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
 
-            if (config) {
-                info("Executing code block: \n```%s\n%s```\n", block->info, block->content);
-                info("Using language config: %s\n", config->name);
+#define BLOCK_SKIPPED (-1)
 
-                // Fork and execute
-                pid_t pid = fork();
-                if (pid == -1) {
-                    perror("fork failed");
-                    return 0;
-                }
+// Start the interpreter of the code block with envp, its stdout and stderr
+// going to out_fds unless NULL. posix_spawn() does not copy our page tables
+// like fork() does, the child shares our memory until it execs. Returns 0
+// with the pid of the interpreter, BLOCK_SKIPPED for a block without info
+// or content, or the exit code of a block which cannot run.
+static int spawn_block(MD_DOCUMENT *doc, CODE_BLOCK *block, char **envp, char **args, int num_args, const int *out_fds, pid_t *pid) {
+    if (!block->info.ptr || !block->content.ptr) {
+        return BLOCK_SKIPPED;
+    }
+    const char                   *lang   = md_cstr(doc, &block->info);
+    const char                   *code   = md_cstr(doc, &block->content);
+    const struct language_config *config = get_language_config(block->info.ptr, block->info.size);
+    if (!config) {
+        error("Unsupported language: %s\n", lang);
+        return 1;
+    }
+    info("Executing code block: \n```%s\n%s```\n", lang, code);
+    info("Using language config: %s\n", config->name);
 
-                if (pid == 0) {
-                    // Child process
-                    // Calculate number of arguments needed
-                    int total_args = config->prefix_args_count; // Prefix arguments
-                    if (num_args > 0) total_args += num_args;   // User arguments
-
-                    // Allocate argument array
-                    char **exec_args = safe_malloc(total_args + 1);
-                    if (!exec_args) {
-                        _exit(1);
-                    }
-
-                    // Fill argument array with prefix args first
-                    int arg_idx = 0;
-                    for (size_t i = 0; i < config->prefix_args_count; i++) {
-                        if (strcmp(config->prefix_args[i], "$CODE") == 0) {
-                            exec_args[arg_idx++] = block->content;
-                        } else if (strcmp(config->prefix_args[i], "$NAME") == 0) {
-                            exec_args[arg_idx++] = (char *)config->name;
-                        } else {
-                            exec_args[arg_idx++] = (char *)config->prefix_args[i];
-                        }
-                    }
-
-                    // Add user arguments
-                    for (int i = 0; i < num_args; i++) {
-                        exec_args[arg_idx++] = args[i];
-                    }
-
-                    exec_args[arg_idx] = NULL;
-
-                    execvp(exec_args[0], exec_args);
-                    perror("execvp failed");
-                    free(exec_args);
-                    _exit(1);
-                } else {
-                    // Parent process
-                    int status;
-                    waitpid(pid, &status, 0);
-
-                    exit_code = WEXITSTATUS(status);
-                    if (!WIFEXITED(status) || exit_code != 0) {
-                        info("Command failed with status %d\n", exit_code);
-                    } else {
-                        info("Command completed successfully %d\n", exit_code);
-                    }
-                }
+    // Argument array, the prefix args first, then the user arguments
+    char **exec_args = safe_malloc((config->prefix_args_count + num_args + 1) * sizeof(char *));
+    int    arg_idx   = 0;
+    for (size_t i = 0; i < config->prefix_args_count; i++) {
+        if (strcmp(config->prefix_args[i], "$CODE") == 0) {
+            exec_args[arg_idx++] = (char *)code;
+        } else if (strcmp(config->prefix_args[i], "$NAME") == 0) {
+            exec_args[arg_idx++] = (char *)config->name;
+        } else {
+            exec_args[arg_idx++] = (char *)config->prefix_args[i];
+        }
+    }
+    for (int i = 0; i < num_args; i++) {
+        exec_args[arg_idx++] = args[i];
+    }
+    exec_args[arg_idx] = NULL;
+
+    posix_spawn_file_actions_t actions;
+    if (out_fds) {
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_adddup2(&actions, out_fds[0], STDOUT_FILENO);
+        posix_spawn_file_actions_adddup2(&actions, out_fds[1], STDERR_FILENO);
+    }
+    const char *program = find_program(config, exec_args[0], envp);
+    int         ret     = program ? posix_spawn(pid, program, out_fds ? &actions : NULL, NULL, exec_args, envp) : ENOENT;
+    if (out_fds) {
+        posix_spawn_file_actions_destroy(&actions);
+    }
+    if (ret != 0) {
+        error("Cannot run %s: %s\n", exec_args[0], strerror(ret));
+    }
+    free(exec_args);
+    return ret != 0;
+}
+
+// Execute code blocks for a given node
+int execute_node(MD_DOCUMENT *doc, MD_NODE *node, char **args, int num_args) {
+    int exit_code = 0;
+    info("Executing node: %.*s\n", MD_TEXT_ARG(node->text));
+    char **envp = node_envp(doc, node);
+
+    STAMP stamp;
+    int   stamp_state = stamp_check(doc, node, envp, args, num_args, &stamp);
+    if (stamp_state == STAMP_UP_TO_DATE) {
+        info("Up to date: %.*s\n", MD_TEXT_ARG(node->text));
+        return 0;
+    }
+
+    for (CODE_BLOCK *block = node->code_block; block && !exit_code; block = block->next) {
+        pid_t pid;
+        int   ret = spawn_block(doc, block, envp, args, num_args, NULL, &pid);
+        if (ret == BLOCK_SKIPPED) {
+            continue;
+        }
+        exit_code = ret ? ret : wait_exit_code(pid);
+        if (exit_code != 0) {
+            info("Command failed with status %d\n", exit_code);
+        } else {
+            info("Command completed successfully %d\n", exit_code);
+        }
+    }
+    if (stamp_state == STAMP_OUT_OF_DATE && exit_code == 0) {
+        stamp_save(&stamp);
+    }
+    return exit_code;
+}
+
+// A heading run by execute_nodes(), one code block after the other
+typedef struct {
+    MD_NODE    *node;
+    int        *deps; // Indexes of the jobs to finish first
+    int         dep_count;
+    char      **args; // Arguments of a heading named on the command line
+    int         num_args;
+    int         started;
+    char      **envp;
+    STAMP       stamp;
+    int         stamp_state;
+    CODE_BLOCK *block;     // Next code block to run
+    pid_t       pid;       // Code block running, 0 for none
+    int         fds[2];    // Read ends of its captured stdout and stderr, -1 when closed
+    BUFFER      output[2]; // Captured stdout and stderr, written out when the job is done
+    int         done;
+    int         exit_code;
+} JOB;
+
+static void finish_job(JOB *job, int exit_code) {
+    job->done      = 1;
+    job->exit_code = exit_code;
+    if (exit_code == 0 && job->stamp_state == STAMP_OUT_OF_DATE) {
+        stamp_save(&job->stamp);
+    }
+    info("Job for %.*s exited with %d\n", MD_TEXT_ARG(job->node->text), exit_code);
+}
+
+// Pipe whose ends are not inherited, only the copies made for the child
+static int open_pipe(int fds[2]) {
+    if (pipe(fds) == -1) {
+        return -1;
+    }
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return 0;
+}
+
+static void close_pipes(int pipes[2][2]) {
+    for (int i = 0; i < 4; i++) {
+        if (pipes[i / 2][i % 2] != -1) {
+            close(pipes[i / 2][i % 2]);
+            pipes[i / 2][i % 2] = -1;
+        }
+    }
+}
+
+// Start the next code block of the job, or finish the job when there is
+// none left. With capture, each block gets new pipes, so the end of its
+// output is seen as end of file.
+static void run_next_block(MD_DOCUMENT *doc, JOB *job, int capture) {
+    while (job->block) {
+        CODE_BLOCK *block = job->block;
+        job->block        = block->next;
+
+        int pipes[2][2] = {{-1, -1}, {-1, -1}};
+        if (capture && (open_pipe(pipes[0]) == -1 || open_pipe(pipes[1]) == -1)) {
+            perror("pipe failed");
+            close_pipes(pipes);
+            finish_job(job, 1);
+            return;
+        }
+        int out_fds[2] = {pipes[0][1], pipes[1][1]};
+        int ret        = spawn_block(doc, block, job->envp, job->args, job->num_args, capture ? out_fds : NULL, &job->pid);
+        if (ret == 0) {
+            job->fds[0] = pipes[0][0];
+            job->fds[1] = pipes[1][0];
+            pipes[0][0] = pipes[1][0] = -1;
+            close_pipes(pipes);
+            return;
+        }
+        job->pid = 0;
+        close_pipes(pipes);
+        if (ret != BLOCK_SKIPPED) {
+            finish_job(job, ret);
+            return;
+        }
+    }
+    finish_job(job, 0);
+}
+
+static void start_job(MD_DOCUMENT *doc, JOB *job, int capture) {
+    job->started     = 1;
+    job->envp        = node_envp(doc, job->node);
+    job->stamp_state = stamp_check(doc, job->node, job->envp, job->args, job->num_args, &job->stamp);
+    if (job->stamp_state == STAMP_UP_TO_DATE) {
+        info("Up to date: %.*s\n", MD_TEXT_ARG(job->node->text));
+        finish_job(job, 0);
+        return;
+    }
+    info("Starting job for: %.*s\n", MD_TEXT_ARG(job->node->text));
+    job->block = job->node->code_block;
+    run_next_block(doc, job, capture);
+}
+
+// Read what is available from the captured output of the running blocks
+static void read_jobs(JOB *jobs, int count) {
+    struct pollfd fds[2 * count];
+    JOB          *owners[2 * count];
+    int           streams[2 * count];
+    int           nfds = 0;
+    for (int i = 0; i < count; i++) {
+        for (int stream = 0; stream < 2; stream++) {
+            if (jobs[i].pid && jobs[i].fds[stream] != -1) {
+                fds[nfds].fd      = jobs[i].fds[stream];
+                fds[nfds].events  = POLLIN;
+                fds[nfds].revents = 0;
+                owners[nfds]      = &jobs[i];
+                streams[nfds++]   = stream;
+            }
+        }
+    }
+    if (nfds == 0) {
+        return;
+    }
+    if (poll(fds, nfds, -1) == -1) {
+        if (errno != EINTR) perror("poll failed");
+        return;
+    }
+
+    char buf[4096];
+    for (int i = 0; i < nfds; i++) {
+        if (!fds[i].revents) continue;
+        ssize_t size = read(fds[i].fd, buf, sizeof(buf));
+        if (size > 0) {
+            buffer_append(&owners[i]->output[streams[i]], buf, size);
+        } else if (size == 0 || errno != EINTR) {
+            close(fds[i].fd);
+            owners[i]->fds[streams[i]] = -1;
+        }
+    }
+}
+
+// Write the output of the jobs done, in the order of the jobs. Jobs left
+// waiting on a failure are never started, their output is skipped over.
+static void write_jobs(JOB *jobs, int count, int *written, int failed) {
+    for (; *written < count && (jobs[*written].done || (failed && !jobs[*written].started)); (*written)++) {
+        JOB *job = &jobs[*written];
+        fwrite(job->output[0].data, 1, job->output[0].size, stdout);
+        fflush(stdout);
+        fwrite(job->output[1].data, 1, job->output[1].size, stderr);
+        fflush(stderr);
+        buffer_free(&job->output[0]);
+        buffer_free(&job->output[1]);
+    }
+}
+
+// Path of headings from a requested one to the dependency being planned
+typedef struct PLAN_PATH PLAN_PATH;
+struct PLAN_PATH {
+    MD_NODE   *node;
+    PLAN_PATH *parent;
+};
+
+typedef struct {
+    JOB *jobs;
+    int  count;
+    int  capacity;
+} PLAN;
+
+static void print_cycle(MD_NODE *node, PLAN_PATH *path) {
+    if (path->node != node) {
+        print_cycle(node, path->parent);
+    }
+    fprintf(stderr, "%.*s -> ", MD_TEXT_ARG(path->node->text));
+}
+
+// Add the job of node after the jobs of its dependencies, so the jobs are in
+// a topological order. A heading depended on more than once gets one job.
+// Returns the index of the job, -1 for an unknown heading or a cycle.
+static int plan_job(MD_DOCUMENT *doc, PLAN *plan, MD_NODE *node, PLAN_PATH *parent) {
+    for (int i = 0; i < plan->count; i++) {
+        if (plan->jobs[i].node == node) return i;
+    }
+    for (PLAN_PATH *p = parent; p; p = p->parent) {
+        if (p->node == node) {
+            error("Dependency cycle: ");
+            print_cycle(node, parent);
+            fprintf(stderr, "%.*s\n", MD_TEXT_ARG(node->text));
+            return -1;
+        }
+    }
+
+    PLAN_PATH path      = {node, parent};
+    int       dep_count = 0;
+    for (DEPENDENCY *dep = node->depends; dep; dep = dep->next) {
+        dep_count++;
+    }
+    int *deps = dep_count ? safe_malloc(dep_count * sizeof(int)) : NULL;
+    int  i    = 0;
+    for (DEPENDENCY *dep = node->depends; dep; dep = dep->next, i++) {
+        MD_NODE *dep_node = md_find_heading(doc, md_cstr(doc, &dep->heading));
+        if (!dep_node) {
+            error("Cannot find heading %.*s, a dependency of %.*s\n", MD_TEXT_ARG(dep->heading), MD_TEXT_ARG(node->text));
+            free(deps);
+            return -1;
+        }
+        if ((deps[i] = plan_job(doc, plan, dep_node, &path)) < 0) {
+            free(deps);
+            return -1;
+        }
+    }
+
+    if (plan->count == plan->capacity) {
+        plan->capacity = plan->capacity ? plan->capacity * 2 : 8;
+        plan->jobs     = safe_realloc(plan->jobs, plan->capacity * sizeof(JOB));
+    }
+    plan->jobs[plan->count] = (JOB){.node = node, .deps = deps, .dep_count = dep_count, .fds = {-1, -1}};
+    info("Planned job %d: %.*s, %d dependencies\n", plan->count, MD_TEXT_ARG(node->text), dep_count);
+    return plan->count++;
+}
+
+// Whether the dependencies of the job all completed successfully
+static int job_ready(JOB *jobs, JOB *job) {
+    for (int i = 0; i < job->dep_count; i++) {
+        if (!jobs[job->deps[i]].done || jobs[job->deps[i]].exit_code) return 0;
+    }
+    return 1;
+}
+
+// Run the headings and the headings they depend on, each once and after
+// its dependencies, at most max_jobs at once. The code blocks are spawned
+// from here, each job with its own envp, so nothing is forked. The output
+// of each job is held until it is done and then written in the order of
+// the plan, so it does not interleave. No new heading is started after one
+// fails. Returns the exit code of the first heading that failed.
+int execute_nodes(MD_DOCUMENT *doc, MD_NODE **nodes, int count, char **args, int num_args, int max_jobs) {
+    PLAN plan = {0};
+    for (int i = 0; i < count; i++) {
+        int job = plan_job(doc, &plan, nodes[i], NULL);
+        if (job < 0) {
+            for (int j = 0; j < plan.count; j++) {
+                free(plan.jobs[j].deps);
+            }
+            free(plan.jobs);
+            return 1;
+        }
+        plan.jobs[job].args     = args;
+        plan.jobs[job].num_args = num_args;
+    }
+
+    JOB *jobs = plan.jobs;
+    count     = plan.count;
+    for (int i = 0; i < count; i++) {
+        md_detach_node(doc, jobs[i].node);
+    }
+    if (count == 1) {
+        free(jobs);
+        return execute_node(doc, nodes[0], args, num_args);
+    }
+
+    // A single job at a time writes to our output directly
+    int capture = max_jobs > 1;
+    int running = 0, written = 0, failed = 0;
+    while (1) {
+        // Dependencies come first in the plan, so one pass also starts the
+        // jobs of the ones which are done at once
+        for (int i = 0; i < count && !failed && running < max_jobs; i++) {
+            if (jobs[i].started || !job_ready(jobs, &jobs[i])) continue;
+            start_job(doc, &jobs[i], capture);
+            if (!jobs[i].done) {
+                running++;
             } else {
-                error("Unsupported language: %s\n", lang);
-                return 1;
+                failed |= jobs[i].exit_code != 0;
             }
         }
-        if (exit_code) {
+        write_jobs(jobs, count, &written, failed);
+        if (running == 0) {
             break;
         }
-        block = block->next;
+
+        // Drain the pipes until a block closes both, then wait for its exit
+        // and go on with the next block of the job
+        for (int i = 0; i < count; i++) {
+            JOB *job = &jobs[i];
+            if (job->pid && job->fds[0] == -1 && job->fds[1] == -1) {
+                int exit_code = wait_exit_code(job->pid);
+                job->pid      = 0;
+                if (exit_code) {
+                    finish_job(job, exit_code);
+                } else {
+                    run_next_block(doc, job, capture);
+                }
+                if (job->done) {
+                    running--;
+                    failed |= job->exit_code != 0;
+                }
+            }
+        }
+        if (capture) {
+            read_jobs(jobs, count);
+        }
     }
+
+    int exit_code = 0;
+    for (int i = 0; i < count; i++) {
+        if (!jobs[i].done) {
+            info("Skipped after a failure: %.*s\n", MD_TEXT_ARG(jobs[i].node->text));
+        } else if (jobs[i].exit_code) {
+            error("%.*s failed with exit code %d\n", MD_TEXT_ARG(jobs[i].node->text), jobs[i].exit_code);
+            if (!exit_code) exit_code = jobs[i].exit_code;
+        }
+        free(jobs[i].deps);
+    }
+    free(jobs);
     return exit_code;
-}
\ No newline at end of file
+}
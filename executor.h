@@ -9,7 +9,9 @@ struct language_config {
     size_t       prefix_args_count;
 };
 
-const struct language_config *get_language_config(const char *lang);
-int                           execute_node(MD_NODE *node, char **args, int num_args);
+const struct language_config *get_language_config(const char *lang, size_t len);
+int                           execute_node(MD_DOCUMENT *doc, MD_NODE *node, char **args, int num_args);
+char                        **node_envp(MD_DOCUMENT *doc, MD_NODE *node);
+int                           execute_nodes(MD_DOCUMENT *doc, MD_NODE **nodes, int count, char **args, int num_args, int max_jobs);
 
 #endif
\ No newline at end of file
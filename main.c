@@ -4,6 +4,7 @@
 #include "logger.c"
 #include "logger.h"
 #include "markdown.c"
+#include "stamp.c"
 #include "tree/tree.h"
 #include "utils.c"
 #include <getopt.h>
@@ -17,22 +18,26 @@ struct config config;
 
 void show_help() {
     printf("USAGE: %s [OPTIONS...] [HEADING] [ARGS...]\n"
+           "       %s [OPTIONS...] -j N HEADING... [-- ARGS...]\n"
            "OPTIONS:\n"
            "  -h, --help              Print this help message\n"
            "  -v, --verbose           Print debug information\n"
            "  -m, --markdown          Print node markdown\n"
            "  -c, --code              Print node code block\n"
            "  -a, --all               Parse code blocks in all languages\n"
-           "  -f, --file [FILE]       Specify the file to parse\n",
-           config.program);
+           "  -f, --file [FILE]       Specify the file to parse, - for stdin\n"
+           "  -j, --jobs [N]          Run all given headings, at most N at once\n"
+           "      --no-cache          Do not use the parsed document cache\n"
+           "      --force             Run headings even when they are up to date\n",
+           config.program, config.program);
 }
 
-void show_hint(MD_NODE *root) {
-    MD_NODE *current      = root;
-    int      max_line_len = 0;
-    int      line_len     = 0;
-    while (current != NULL) {
-        Tree *tree        = md_to_command_tree(current->child, new_tree(current->text));
+void show_hint(MD_DOCUMENT *doc) {
+    MD_NODES *nodes        = &doc->nodes;
+    int       max_line_len = 0;
+    int       line_len     = 0;
+    for (int i = nodes->count ? 0 : MD_NODE_NONE; i != MD_NODE_NONE; i = nodes->next_sibling[i]) {
+        Tree *tree        = md_to_command_tree(doc, nodes->first_child[i], new_tree(md_cstr(doc, &nodes->node[i]->text)));
         char *tree_string = print_tree(tree);
 
         for (int i = 0; tree_string[i]; i++) {
@@ -50,16 +55,37 @@ void show_hint(MD_NODE *root) {
                 line_len++;
             }
         }
-
-        current = current->next;
     }
 
-    current = root;
-    while (current != NULL) {
-        Tree *tree        = md_to_command_tree2(current->child, new_tree(current->text), max_line_len);
+    for (int i = nodes->count ? 0 : MD_NODE_NONE; i != MD_NODE_NONE; i = nodes->next_sibling[i]) {
+        Tree *tree        = md_to_command_tree2(doc, nodes->first_child[i], new_tree(md_cstr(doc, &nodes->node[i]->text)), max_line_len);
         char *tree_string = print_tree(tree);
         printf("%s\n", print_tree(tree));
-        current = current->next;
+    }
+}
+
+// Job count of -j, -1 when it is not a positive number
+int parse_jobs(const char *str) {
+    char *end;
+    long  jobs = strtol(str, &end, 10);
+    if (end == str || *end || jobs < 1 || jobs > 1024) {
+        return -1;
+    }
+    return jobs;
+}
+
+// Print the markdown or the code blocks of node as asked by -m and -c
+void print_node(MD_DOCUMENT *doc, MD_NODE *node) {
+    if (config.markdown) {
+        printf("%s", md_node_to_markdown(doc, node->index));
+    }
+    if (config.code) {
+        info("Printing code blocks.\n");
+        CODE_BLOCK *code_block = node->code_block;
+        while (code_block) {
+            printf("%.*s", MD_TEXT_ARG(code_block->content));
+            code_block = code_block->next;
+        }
     }
 }
 
@@ -100,8 +126,8 @@ int main(int argc, char **argv) {
                                 config.file_path = current_arg + short_opt_index + 1;
                             } else {
                                 // Current argument is not the last argument,
-                                // and next argument is not an option.
-                                if (arg_index < argc - 1 && argv[arg_index + 1][0] != '-') {
+                                // and next argument is not an option ("-" is stdin).
+                                if (arg_index < argc - 1 && (argv[arg_index + 1][0] != '-' || strcmp(argv[arg_index + 1], "-") == 0)) {
                                     config.file_path = argv[arg_index + 1];
                                     arg_index++;
                                 } else {
@@ -111,6 +137,23 @@ int main(int argc, char **argv) {
                             }
                             short_opt_index = current_arg_len; // Go to parse next argument
                             break;
+                        case 'j': { // Pattern: -jN, -j N
+                            char *jobs = NULL;
+                            if (short_opt_index < current_arg_len - 1) {
+                                jobs = current_arg + short_opt_index + 1;
+                            } else if (arg_index < argc - 1) {
+                                jobs = argv[++arg_index];
+                            } else {
+                                error("No job count specified after -j\n");
+                                return 1;
+                            }
+                            if ((config.jobs = parse_jobs(jobs)) < 0) {
+                                error("Invalid job count: %s\n", jobs);
+                                return 1;
+                            }
+                            short_opt_index = current_arg_len;
+                            break;
+                        }
                         default:
                             error("Unknown option: %c\n", short_opt);
                             return 1;
@@ -127,11 +170,26 @@ int main(int argc, char **argv) {
                     config.code = 1;
                 } else if (strcmp(current_arg, "--all") == 0) {
                     config.all = 1;
+                } else if (strcmp(current_arg, "--no-cache") == 0) {
+                    config.no_cache = 1;
+                } else if (strcmp(current_arg, "--force") == 0) {
+                    config.force = 1;
                 } else if (strncmp(current_arg, "--file=", 7) == 0 && current_arg_len > 7) { // Pattern: --file=**
                     config.file_path = current_arg + 7;
                 } else if (strcmp(current_arg, "--file") == 0 && arg_index < argc - 1) { // Pattern: --file **
                     config.file_path = argv[arg_index + 1];
                     arg_index++;
+                } else if (strncmp(current_arg, "--jobs=", 7) == 0) { // Pattern: --jobs=N
+                    if ((config.jobs = parse_jobs(current_arg + 7)) < 0) {
+                        error("Invalid job count: %s\n", current_arg + 7);
+                        return 1;
+                    }
+                } else if (strcmp(current_arg, "--jobs") == 0 && arg_index < argc - 1) { // Pattern: --jobs N
+                    if ((config.jobs = parse_jobs(argv[arg_index + 1])) < 0) {
+                        error("Invalid job count: %s\n", argv[arg_index + 1]);
+                        return 1;
+                    }
+                    arg_index++;
                 } else {
                     error("Unknown option: %s\n", current_arg);
                     return 1;
@@ -166,6 +224,18 @@ int main(int argc, char **argv) {
         info("--all flag is set\n");
     }
 
+    if (config.no_cache) {
+        info("--no-cache flag is set\n");
+    }
+
+    if (config.force) {
+        info("--force flag is set\n");
+    }
+
+    if (config.jobs) {
+        info("--jobs is set to %d\n", config.jobs);
+    }
+
     // Find and read markdown file
     if (!config.file_path) {
         config.file_path = find_doc(config.program);
@@ -180,46 +250,105 @@ int main(int argc, char **argv) {
     info("Using markdown file: %s\n", config.file_path);
     setenv("MD_EXE", argv[0], 1);
 
-    MD_NODE *root = md_parse_file(config.file_path);
+    // A single heading is parsed up to its section only, so running it costs
+    // the same however long the document is. The cache serves the listing
+    // and -j, and is filled from a whole parse in the background when the
+    // stat fields say it is stale. stdin is parsed whole, it cannot be read
+    // again for the headings the section depends on.
+    int          is_stdin   = strcmp(config.file_path, "-") == 0;
+    int          use_cache  = !config.no_cache && !is_stdin;
+    int          fill_cache = 0;
+    const char  *section    = !is_stdin && !config.jobs && arg_index < argc ? argv[arg_index] : NULL;
+    MD_DOCUMENT *doc        = use_cache && !section ? md_cache_load(config.file_path) : NULL;
+    if (!doc) {
+        doc = md_parse_file(config.file_path, section);
+        if (doc && use_cache && doc->is_partial) {
+            fill_cache = !md_cache_fresh(config.file_path);
+        } else if (doc && use_cache && !(section && md_cache_fresh(config.file_path))) {
+            md_cache_save(doc, config.file_path);
+        }
+    }
+    if (!doc) {
+        return 1;
+    }
+    int exit_code = 0;
+
+    if (arg_index < argc && config.jobs) {
+        // Every argument up to "--" is a heading, the ones after it are
+        // passed to each of them
+        int heading_count = 0;
+        while (arg_index + heading_count < argc && strcmp(argv[arg_index + heading_count], "--") != 0) {
+            heading_count++;
+        }
+        char **headings = argv + arg_index;
+        char **sub_argv = headings + heading_count + (arg_index + heading_count < argc);
+        int    sub_argc = argc - (sub_argv - argv);
+        info("headings: %d, argument count: %d\n", heading_count, sub_argc);
+
+        MD_NODE **nodes = safe_malloc((heading_count + 1) * sizeof(MD_NODE *));
+        for (int i = 0; i < heading_count; i++) {
+            nodes[i] = md_find_heading(doc, headings[i]);
+            if (!nodes[i]) {
+                error("Cannot find heading: %s\n", headings[i]);
+                exit_code = 1;
+            }
+        }
 
-    if (arg_index < argc) {
+        if (exit_code) {
+            // Nothing runs unless every heading is found
+        } else if (config.markdown || config.code) {
+            for (int i = 0; i < heading_count; i++) {
+                print_node(doc, nodes[i]);
+            }
+        } else {
+            exit_code = execute_nodes(doc, nodes, heading_count, sub_argv, sub_argc, config.jobs);
+        }
+        free(nodes);
+    } else if (arg_index < argc) {
         char  *heading  = argv[arg_index++];
         char **sub_argv = argv + arg_index;
         int    sub_argc = argc - arg_index;
         info("heading: %s, argument count: %d\n", heading, sub_argc);
-        MD_NODE *node_found = md_find_node(root, heading);
+        MD_NODE *node_found = md_find_heading(doc, heading);
+
+        // Parsing only the section left out the headings it depends on
+        if (node_found && node_found->depends && doc->is_partial && !config.markdown && !config.code) {
+            info("Loading whole document for the dependencies\n");
+            md_free_document(doc);
+            doc = use_cache && !fill_cache ? md_cache_load(config.file_path) : NULL;
+            if (!doc) {
+                doc = md_parse_file(config.file_path, NULL);
+            }
+            node_found = doc ? md_find_heading(doc, heading) : NULL;
+            if (doc && fill_cache) {
+                md_cache_save(doc, config.file_path);
+                fill_cache = 0;
+            }
+        }
+        if (fill_cache) {
+            md_cache_save_background(config.file_path);
+        }
 
         if (node_found) {
-            info("Found node: %s\n", node_found->text);
-            // Do not print next node.
-            node_found->next = NULL;
+            info("Found node: %.*s\n", MD_TEXT_ARG(node_found->text));
             if (config.markdown || config.code) {
-                if (config.markdown) {
-                    printf("%s", md_node_to_markdown(node_found));
-                }
-                if (config.code) {
-                    info("Printing code blocks.\n");
-                    CODE_BLOCK *code_block = node_found->code_block;
-                    while (code_block) {
-                        printf("%s", code_block->content);
-                        code_block = code_block->next;
-                    }
-                }
+                print_node(doc, node_found);
             } else {
-                return execute_node(node_found, sub_argv, sub_argc);
+                exit_code = execute_nodes(doc, &node_found, 1, sub_argv, sub_argc, 1);
             }
         } else {
             error("Cannot find heading: %s\n", heading);
-            return 1;
+            exit_code = 1;
         }
     } else {
         info("No command specified, printing hints.\n");
         if (config.markdown) {
-            printf("%s", md_node_to_markdown(root));
+            printf("%s", md_document_to_markdown(doc));
         } else {
-            show_hint(root);
+            show_hint(doc);
         }
     }
 
-    return 0;
+    md_free_document(doc);
+    return exit_code;
 }
\ No newline at end of file
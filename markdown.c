@@ -1,55 +1,70 @@
 #include "markdown.h"
+#include "arena.c"
+#include "cache.c"
 #include "config.h"
 #include "executor.h"
 #include "logger.h"
 #include "md4c/md4c.c"
+#include "scan.c"
+#include "source.c"
 #include "tree/tree.c"
 #include "utils.h"
+#include <ctype.h>
+#include <errno.h>
+#include <stdarg.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
-CODE_BLOCK *new_code_block(char *info) {
-    CODE_BLOCK *block = safe_malloc(sizeof(CODE_BLOCK));
+CODE_BLOCK *new_code_block(ARENA *arena, MD_TEXT info) {
+    CODE_BLOCK *block = arena_alloc(arena, sizeof(CODE_BLOCK));
     block->info       = info;
-    block->content    = NULL;
+    block->content    = (MD_TEXT){0};
     block->next       = NULL;
     return block;
 }
 
-TABLE *new_table(unsigned col_count, unsigned head_row_count, unsigned body_row_count) {
-    TABLE *table          = safe_malloc(sizeof(TABLE));
+// Shape table for the next table, its cells empty. The cell array only
+// grows, so a document of many tables allocates for the largest one.
+void table_reset(TABLE *table, unsigned col_count, unsigned head_row_count, unsigned body_row_count) {
+    size_t count = (size_t)col_count * (head_row_count + body_row_count);
+    if (count > table->capacity) {
+        size_t capacity = count > 2 * table->capacity ? count : 2 * table->capacity;
+        table->cells    = safe_realloc(table->cells, capacity * sizeof(MD_TEXT));
+        table->capacity = capacity;
+    }
+    memset(table->cells, 0, count * sizeof(MD_TEXT));
     table->col_count      = col_count;
     table->head_row_count = head_row_count;
     table->body_row_count = body_row_count;
+}
 
-    // Allocate memory for header
-    table->head = safe_malloc(sizeof(char **) * table->head_row_count);
-    for (int i = 0; i < table->head_row_count; i++) {
-        table->head[i] = calloc(table->col_count, sizeof(char *));
-    }
-
-    // Allocate memory for body
-    table->body = safe_malloc(sizeof(char **) * table->body_row_count);
-    for (int i = 0; i < table->body_row_count; i++) {
-        table->body[i] = calloc(table->col_count, sizeof(char *));
-    }
-    return table;
+void table_free(TABLE *table) {
+    free(table->cells);
+    *table = (TABLE){0};
 }
 
-MD_NODE *new_md_node() {
-    MD_NODE *node     = safe_malloc(sizeof(MD_NODE));
+MD_NODE *new_md_node(ARENA *arena) {
+    MD_NODE *node     = arena_alloc(arena, sizeof(MD_NODE));
     node->level       = 0;
-    node->text        = NULL;
-    node->description = NULL;
-
-    node->code_block = NULL;
-    node->env_entry  = NULL;
-
-    node->next   = NULL;
-    node->child  = NULL;
-    node->parent = NULL;
+    node->text        = (MD_TEXT){0};
+    node->description = (MD_TEXT){0};
+
+    node->code_block      = NULL;
+    node->code_block_tail = NULL;
+    node->env_entry       = NULL;
+    node->env_entry_tail  = NULL;
+    node->depends         = NULL;
+    node->depends_tail    = NULL;
+    node->envp            = NULL;
+
+    node->next      = NULL;
+    node->child     = NULL;
+    node->parent    = NULL;
+    node->is_orphan = 0;
+    node->index     = MD_NODE_NONE;
 
     return node;
 }
@@ -59,24 +74,114 @@ typedef struct {
     int          depth;
     MD_BLOCKTYPE block_type;
     MD_SPANTYPE  span_type;
-    char        *content;
 
-    TABLE *table;
+    // Text of the current block. It stays a view into the source while the
+    // spans are contiguous in it and is only copied into content once they
+    // are not. The content buffer is reused across blocks.
+    const char *source;
+    size_t      source_size;
+    const char *view;
+    size_t      view_size;
+    BUFFER      content;
+
+    TABLE  table;
     int    row_index;
     int    cell_index;
 
-    MD_NODE *root;
-    MD_NODE *last;
+    // Task list items being parsed, their text becomes env entries
+    int task_depth;
+
+    MD_DOCUMENT *doc;
+    ARENA       *arena;
+    MD_NODE     *root;
+    MD_NODE     *last;
+
+    // Requested heading, parsing stops once its section is complete
+    const char *target;
+    MD_NODE    *target_node;
 } CallbackData;
 
-char *substr(char *str, int start, int length) {
-    if (!str || start < 0 || length < 0 || start + length > strlen(str)) {
+// Returned from the callbacks to stop md4c early. md4c only unwinds nested
+// block processing on negative values and uses -1 for its own errors.
+#define STOP_PARSING (-2)
+
+const char *md_cstr(MD_DOCUMENT *doc, MD_TEXT *text) {
+    if (!text->ptr) {
         return NULL;
     }
-    char *sub = (char *)safe_malloc(length + 1);
-    memcpy(sub, str + start, length);
-    sub[length] = '\0';
-    return sub;
+    if (!text->is_cstr) {
+        text->ptr     = arena_strndup(&doc->arena, text->ptr, text->size);
+        text->is_cstr = 1;
+    }
+    return text->ptr;
+}
+
+// Copy text into the arena when it is a view into a mapped source
+static void md_text_detach(MD_DOCUMENT *doc, MD_TEXT *text) {
+    const char *data = doc->source.data;
+    if (doc->source.is_mapped && text->ptr >= data && text->ptr < data + doc->source.size) {
+        md_cstr(doc, text);
+    }
+}
+
+// Copy what running node reads, its text, code blocks and the env tables up
+// to the root, out of a mapped source. The code blocks may change or
+// truncate the markdown file, which would otherwise change the text of the
+// blocks still to run or fault on pages past the new end of the file.
+void md_detach_node(MD_DOCUMENT *doc, MD_NODE *node) {
+    md_text_detach(doc, &node->text);
+    for (CODE_BLOCK *block = node->code_block; block; block = block->next) {
+        md_text_detach(doc, &block->info);
+        md_text_detach(doc, &block->content);
+    }
+    for (MD_NODE *current = node; current; current = current->parent) {
+        for (ENV_ENTRY *env = current->env_entry; env; env = env->next) {
+            md_text_detach(doc, &env->key);
+            md_text_detach(doc, &env->value);
+        }
+    }
+}
+
+int md_text_equal(const MD_TEXT *text, const char *str) {
+    return text->ptr && strlen(str) == text->size && strncmp(text->ptr, str, text->size) == 0;
+}
+
+int md_text_case_equal(const MD_TEXT *text, const char *str) {
+    return text->ptr && strlen(str) == text->size && strncasecmp(text->ptr, str, text->size) == 0;
+}
+
+static MD_TEXT md_text_static(const char *str) {
+    return (MD_TEXT){.ptr = str, .size = strlen(str), .is_cstr = 1};
+}
+
+// Reference text passed by md4c, copying it when it does not live in the source
+static MD_TEXT md_text_view(CallbackData *data, const char *ptr, size_t size) {
+    MD_TEXT text = {.ptr = ptr, .size = size};
+    if (ptr && (ptr < data->source || ptr + size > data->source + data->source_size)) {
+        text.ptr     = arena_strndup(data->arena, ptr, size);
+        text.is_cstr = 1;
+    }
+    return text;
+}
+
+// Take the text of the current block, keeping it as a view when possible
+static MD_TEXT take_text(CallbackData *data) {
+    MD_TEXT text = {0};
+    if (data->content.size) {
+        text.ptr     = arena_strndup(data->arena, data->content.data, data->content.size);
+        text.size    = data->content.size;
+        text.is_cstr = 1;
+    } else if (data->view) {
+        text.ptr  = data->view;
+        text.size = data->view_size;
+    }
+    return text;
+}
+
+static void reset_text(CallbackData *data) {
+    buffer_reset(&data->content);
+    data->view      = NULL;
+    data->view_size = 0;
 }
 
 void print_indention(int count) {
@@ -96,25 +201,29 @@ void md_print_ast(MD_NODE *node, int depth) {
     }
 
     // Print heading
-    if (node->text) {
-        printf("Heading (Level %d): %s\n", node->level, node->text);
+    if (node->text.ptr) {
+        printf("Heading (Level %d): %.*s\n", node->level, MD_TEXT_ARG(node->text));
     }
 
     // Print description
-    if (node->description) {
-        printf("Description: %s\n", node->description);
+    if (node->description.ptr) {
+        printf("Description: %.*s\n", MD_TEXT_ARG(node->description));
     }
 
     ENV_ENTRY *env_entry = node->env_entry;
     while (env_entry) {
-        printf("%s=%s\n", env_entry->key, env_entry->value);
+        printf("%.*s=%.*s\n", MD_TEXT_ARG(env_entry->key), MD_TEXT_ARG(env_entry->value));
         env_entry = env_entry->next;
     }
 
+    for (DEPENDENCY *dep = node->depends; dep; dep = dep->next) {
+        printf("Depends: %.*s\n", MD_TEXT_ARG(dep->heading));
+    }
+
     // Print code blocks
     CODE_BLOCK *block = node->code_block;
     while (block) {
-        printf("```%s\n%s```\n", block->info, block->content);
+        printf("```%.*s\n%.*s```\n", MD_TEXT_ARG(block->info), MD_TEXT_ARG(block->content));
         block = block->next;
     }
 
@@ -142,7 +251,7 @@ void md_print_table(TABLE *table) {
     for (int row = 0; row < table->head_row_count; row++) {
         for (int col = 0; col < table->col_count; col++) {
             if (col > 0) printf(" | ");
-            printf("%s", table->head[row][col] ? table->head[row][col] : "");
+            printf("%.*s", MD_TEXT_ARG(TABLE_HEAD(table, row, col)));
         }
         printf("\n");
     }
@@ -158,7 +267,7 @@ void md_print_table(TABLE *table) {
     for (int row = 0; row < table->body_row_count; row++) {
         for (int col = 0; col < table->col_count; col++) {
             if (col > 0) printf(" | ");
-            printf("%s", table->body[row][col] ? table->body[row][col] : "");
+            printf("%.*s", MD_TEXT_ARG(TABLE_BODY(table, row, col)));
         }
         printf("\n");
     }
@@ -168,19 +277,105 @@ void md_print_table(TABLE *table) {
 static int text_callback(MD_TEXTTYPE type, const MD_CHAR *text, MD_SIZE size, void *userdata) {
     CallbackData *data = (CallbackData *)userdata;
 
-    char *content = substr((char *)text, 0, size);
-    if (data->content == NULL) {
-        data->content = content;
-    } else {
-        size_t len1   = strlen(data->content);
-        size_t len2   = strlen(content);
-        data->content = (char *)realloc(data->content, len1 + len2 + 1);
-        strcat(data->content, substr((char *)text, 0, size));
+    if (data->content.size == 0) {
+        const char *source_end = data->source + data->source_size;
+        if (data->view == NULL) {
+            if (text >= data->source && text + size <= source_end) {
+                data->view      = text;
+                data->view_size = size;
+                return 0;
+            }
+        } else {
+            // Spans not taken from the source (e.g. the "\n" md4c appends to
+            // code lines) still extend the view when the source has the
+            // same bytes at that position.
+            const char *view_end = data->view + data->view_size;
+            if (view_end + size <= source_end && memcmp(view_end, text, size) == 0) {
+                data->view_size += size;
+                return 0;
+            }
+        }
     }
 
+    if (data->content.size == 0 && data->view) {
+        // The text no longer matches the source, copy what was viewed so far
+        buffer_append(&data->content, data->view, data->view_size);
+    }
+    buffer_append(&data->content, text, size);
+
     return 0;
 }
 
+// FNV-1a over the ASCII case-folded text, matching strcasecmp()
+size_t md_index_hash(const char *str, size_t len) {
+    size_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)tolower((unsigned char)str[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void md_index_grow(MD_DOCUMENT *doc) {
+    size_t    capacity = doc->index_capacity ? doc->index_capacity * 2 : 64;
+    MD_NODE **index    = safe_calloc(capacity, sizeof(MD_NODE *));
+
+    for (size_t i = 0; i < doc->index_capacity; i++) {
+        MD_NODE *node = doc->index[i];
+        if (node) {
+            size_t slot = md_index_hash(node->text.ptr, node->text.size) & (capacity - 1);
+            while (index[slot]) {
+                slot = (slot + 1) & (capacity - 1);
+            }
+            index[slot] = node;
+        }
+    }
+
+    free(doc->index);
+    doc->index          = index;
+    doc->index_capacity = capacity;
+}
+
+void md_index_insert(MD_DOCUMENT *doc, MD_NODE *node) {
+    if (!node->text.ptr) {
+        return;
+    }
+    if ((doc->index_count + 1) * 2 > doc->index_capacity) {
+        md_index_grow(doc);
+    }
+
+    size_t mask = doc->index_capacity - 1;
+    size_t slot = md_index_hash(node->text.ptr, node->text.size) & mask;
+    while (doc->index[slot]) {
+        MD_NODE *other = doc->index[slot];
+        if (other->text.size == node->text.size && strncasecmp(other->text.ptr, node->text.ptr, node->text.size) == 0) {
+            // Keep the first match in document order
+            return;
+        }
+        slot = (slot + 1) & mask;
+    }
+    doc->index[slot] = node;
+    doc->index_count++;
+}
+
+static void append_dependency(MD_NODE *node, DEPENDENCY *dep) {
+    if (!node->depends) {
+        node->depends = dep;
+    } else {
+        node->depends_tail->next = dep;
+    }
+    node->depends_tail = dep;
+}
+
+static void append_env_entry(MD_NODE *node, ENV_ENTRY *env) {
+    if (!node->env_entry) {
+        node->env_entry = env;
+    } else {
+        node->env_entry_tail->next = env;
+    }
+    node->env_entry_tail = env;
+}
+
 // Block enter callback
 static int enter_block_callback(MD_BLOCKTYPE type, void *detail, void *userdata) {
     if (!userdata) {
@@ -189,8 +384,7 @@ static int enter_block_callback(MD_BLOCKTYPE type, void *detail, void *userdata)
     CallbackData *data = (CallbackData *)userdata;
     data->block_type   = type;
 
-    free(data->content);
-    data->content = NULL;
+    reset_text(data);
 
     switch (type) {
         case MD_BLOCK_DOC:
@@ -210,6 +404,7 @@ static int enter_block_callback(MD_BLOCKTYPE type, void *detail, void *userdata)
         case MD_BLOCK_LI:
             if (detail) {
                 MD_BLOCK_LI_DETAIL *d = (MD_BLOCK_LI_DETAIL *)detail;
+                data->task_depth += d->is_task;
             }
             break;
         case MD_BLOCK_HR:
@@ -217,6 +412,12 @@ static int enter_block_callback(MD_BLOCKTYPE type, void *detail, void *userdata)
         case MD_BLOCK_H:
             if (detail) {
                 MD_BLOCK_H_DETAIL *d = (MD_BLOCK_H_DETAIL *)detail;
+                // A heading which is not a subsection ends the requested
+                // section. Its ancestors were parsed before it, so their
+                // env entries are complete.
+                if (data->target_node && d->level <= data->target_node->level) {
+                    return STOP_PARSING;
+                }
             }
             break;
         case MD_BLOCK_CODE:
@@ -229,7 +430,7 @@ static int enter_block_callback(MD_BLOCKTYPE type, void *detail, void *userdata)
         case MD_BLOCK_TABLE:
             if (detail) {
                 MD_BLOCK_TABLE_DETAIL *d = (MD_BLOCK_TABLE_DETAIL *)detail;
-                data->table              = new_table(d->col_count, d->head_row_count, d->body_row_count);
+                table_reset(&data->table, d->col_count, d->head_row_count, d->body_row_count);
             }
             break;
         case MD_BLOCK_TH:
@@ -276,21 +477,13 @@ static int leave_block_callback(MD_BLOCKTYPE type, void *detail, void *userdata)
         case MD_BLOCK_LI:
             if (detail) {
                 MD_BLOCK_LI_DETAIL *d = (MD_BLOCK_LI_DETAIL *)detail;
+                data->task_depth -= d->is_task;
                 if (d->is_task) {
-                    ENV_ENTRY *new_env = safe_malloc(sizeof(ENV_ENTRY));
-                    new_env->key       = strdup(data->content);
-                    new_env->value     = d->task_mark == ' ' ? "0" : "1";
+                    ENV_ENTRY *new_env = arena_alloc(data->arena, sizeof(ENV_ENTRY));
+                    new_env->key       = take_text(data);
+                    new_env->value     = md_text_static(d->task_mark == ' ' ? "0" : "1");
                     new_env->next      = NULL;
-
-                    if (data->last->env_entry == NULL) {
-                        data->last->env_entry = new_env;
-                    } else {
-                        ENV_ENTRY *last = data->last->env_entry;
-                        while (last->next) {
-                            last = last->next;
-                        }
-                        last->next = new_env;
-                    }
+                    append_env_entry(data->last, new_env);
                 }
             }
             break;
@@ -299,56 +492,47 @@ static int leave_block_callback(MD_BLOCKTYPE type, void *detail, void *userdata)
         case MD_BLOCK_CODE:
             if (detail) {
                 MD_BLOCK_CODE_DETAIL *c_detail = (MD_BLOCK_CODE_DETAIL *)detail;
-                char                 *info     = substr((char *)c_detail->info.text, 0, c_detail->info.size);
+                MD_TEXT               info     = md_text_view(data, c_detail->info.text, c_detail->info.size);
 
-                const struct language_config *lang_config = get_language_config(info);
+                const struct language_config *lang_config = get_language_config(info.ptr, info.size);
                 if (config.all || lang_config) {
                     // printf("Node: %s, content: %s\n", data->last->text, data->content);
-                    CODE_BLOCK *new_code = new_code_block(info);
-                    new_code->info       = info;
-                    new_code->content    = strdup(data->content);
+                    CODE_BLOCK *new_code = new_code_block(data->arena, info);
+                    new_code->content    = take_text(data);
 
-                    CODE_BLOCK *last = data->last->code_block;
-                    if (!last) {
+                    if (!data->last->code_block) {
                         data->last->code_block = new_code;
                     } else {
-                        while (last->next) {
-                            last = last->next;
-                        }
-                        last->next = new_code;
+                        data->last->code_block_tail->next = new_code;
                     }
+                    data->last->code_block_tail = new_code;
                 }
             }
             break;
         case MD_BLOCK_HTML:
             break;
         case MD_BLOCK_TABLE: {
-            TABLE *table = data->table;
-            if (table->head_row_count == 1 && table->body_row_count > 0) {
-                if (strcmp("key", table->head[0][0]) == 0 && strcmp("value", table->head[0][1]) == 0) {
-                    ENV_ENTRY *last = NULL;
+            TABLE *table = &data->table;
+            if (table->head_row_count == 1 && table->body_row_count > 0 && md_text_equal(&TABLE_HEAD(table, 0, 0), "depends")) {
+                // Headings in the first column, the other columns are notes
+                DEPENDENCY *deps = arena_alloc(data->arena, table->body_row_count * sizeof(DEPENDENCY));
+                for (int i = 0; i < table->body_row_count; i++) {
+                    deps[i].heading = TABLE_BODY(table, i, 0);
+                    deps[i].next    = NULL;
+                    if (deps[i].heading.size) {
+                        append_dependency(data->last, &deps[i]);
+                    }
+                }
+            } else if (table->head_row_count == 1 && table->body_row_count > 0 && table->col_count >= 2) {
+                if (md_text_equal(&TABLE_HEAD(table, 0, 0), "key") && md_text_equal(&TABLE_HEAD(table, 0, 1), "value")) {
+                    // One allocation for the entries of all rows
+                    ENV_ENTRY *entries = arena_alloc(data->arena, table->body_row_count * sizeof(ENV_ENTRY));
                     for (int i = 0; i < table->body_row_count; i++) {
-                        ENV_ENTRY *new_env = safe_malloc(sizeof(ENV_ENTRY));
-                        new_env->key       = table->body[i][0];
-                        new_env->value     = table->body[i][1];
+                        ENV_ENTRY *new_env = &entries[i];
+                        new_env->key       = TABLE_BODY(table, i, 0);
+                        new_env->value     = TABLE_BODY(table, i, 1);
                         new_env->next      = NULL;
-
-                        if (!last) {
-                            // For the first time
-                            if (!data->last->env_entry) {
-                                data->last->env_entry = new_env;
-                            } else {
-                                last = data->last->env_entry;
-                                while (last->next) {
-                                    last = last->next;
-                                }
-                                last->next = new_env;
-                            }
-                        } else {
-                            last->next = new_env;
-                        }
-
-                        last = new_env;
+                        append_env_entry(data->last, new_env);
                     }
                 }
             }
@@ -358,37 +542,49 @@ static int leave_block_callback(MD_BLOCKTYPE type, void *detail, void *userdata)
             break;
         case MD_BLOCK_H: {
             MD_BLOCK_H_DETAIL *d        = (MD_BLOCK_H_DETAIL *)detail;
-            MD_NODE           *new_node = new_md_node();
+            MD_NODE           *new_node = new_md_node(data->arena);
             new_node->level             = d->level;
-            new_node->text              = strdup(data->content);
+            new_node->text              = take_text(data);
 
             if (data->root == NULL) {
                 data->root = new_node;
             } else {
                 if (d->level == data->last->level) {
-                    data->last->next = new_node;
-                    new_node->parent = data->last->parent;
+                    data->last->next    = new_node;
+                    new_node->parent    = data->last->parent;
+                    new_node->is_orphan = data->last->is_orphan;
                 } else if (d->level > data->last->level) {
-                    data->last->child = new_node;
-                    new_node->parent  = data->last;
+                    data->last->child   = new_node;
+                    new_node->parent    = data->last;
+                    new_node->is_orphan = data->last->is_orphan;
                 } else if (d->level < data->last->level) {
-                    MD_NODE *parent = data->last->parent;
+                    // Without an ancestor of the same level the node is left
+                    // unlinked, together with everything below it.
+                    MD_NODE *parent     = data->last->parent;
+                    new_node->is_orphan = 1;
                     while (parent) {
                         if (parent->level == d->level) {
-                            parent->next     = new_node;
-                            new_node->parent = parent->parent;
+                            parent->next        = new_node;
+                            new_node->parent    = parent->parent;
+                            new_node->is_orphan = parent->is_orphan;
                             break;
                         }
                         parent = parent->parent;
                     }
                 }
             }
+            if (!new_node->is_orphan) {
+                md_index_insert(data->doc, new_node);
+                if (data->target && !data->target_node && md_text_case_equal(&new_node->text, data->target)) {
+                    data->target_node = new_node;
+                }
+            }
             data->last = new_node;
             break;
         }
         case MD_BLOCK_P:
             if (!data->last->code_block) {
-                data->last->description = data->content == NULL ? NULL : strdup(data->content);
+                data->last->description = take_text(data);
             }
             break;
         case MD_BLOCK_TR:
@@ -396,18 +592,17 @@ static int leave_block_callback(MD_BLOCKTYPE type, void *detail, void *userdata)
             break;
         case MD_BLOCK_TH:
             // printf("th: %d%d %s\n", data->row_index, data->cell_index, data->content);
-            data->table->head[data->row_index][data->cell_index] = data->content == NULL ? NULL : strdup(data->content);
+            TABLE_HEAD(&data->table, data->row_index, data->cell_index) = take_text(data);
             data->cell_index++;
             break;
         case MD_BLOCK_TD:
             // printf("tb: %d%d %s\n", data->row_index, data->cell_index, data->content);
-            data->table->body[data->row_index][data->cell_index] = data->content == NULL ? NULL : strdup(data->content);
+            TABLE_BODY(&data->table, data->row_index, data->cell_index) = take_text(data);
             data->cell_index++;
             break;
     }
 
-    free(data->content);
-    data->content = NULL;
+    reset_text(data);
 
     if (data->depth > 0) {
         data->depth--;
@@ -473,119 +668,293 @@ static int leave_span_callback(MD_SPANTYPE type, void *detail, void *userdata) {
     return 0;
 }
 
-MD_NODE *md_parse_file(char *file_path) {
-    FILE *fp = fopen(file_path, "rb");
-    if (!fp) {
-        error("Cannot open README.md\n");
-        return NULL;
+// Blocks whose text is dropped are parsed as plain text, md4c then skips
+// resolving their spans. These are paragraphs after the first code block of
+// a section, except in task items, and body cells of tables other than
+// key/value and depends tables.
+static int plain_text_callback(MD_BLOCKTYPE type, void *detail, void *userdata) {
+    CallbackData *data = (CallbackData *)userdata;
+    switch (type) {
+        case MD_BLOCK_P:
+            return data->last && data->last->code_block && data->task_depth == 0;
+        case MD_BLOCK_TD: {
+            TABLE *table = &data->table;
+            if (md_text_equal(&TABLE_HEAD(table, 0, 0), "depends")) {
+                return 0;
+            }
+            return table->col_count < 2 || !md_text_equal(&TABLE_HEAD(table, 0, 0), "key") ||
+                   !md_text_equal(&TABLE_HEAD(table, 0, 1), "value");
+        }
+        default:
+            return 0;
     }
+}
 
-    // Get file size
-    fseek(fp, 0, SEEK_END);
-    long size = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
+// Parse only the section of heading and the own content of its ancestors,
+// located by md_scan(). Returns -1 when the document has to be parsed as a
+// whole, otherwise 0 with the md4c result in result.
+static int md_parse_section(MD_PARSER_CTX *parser, CallbackData *data, const char *heading, int *result) {
+    MD_SCAN scan;
+    if (md_scan(&scan, data->source, data->source_size, heading) != 0 || scan.target < 0) {
+        info("Parsing whole document: %s\n", scan.unsafe ? scan.unsafe : "heading not found by the scanner");
+        md_scan_free(&scan);
+        return -1;
+    }
 
-    if (size <= 0) {
-        fclose(fp);
-        error("Empty file\n");
-        return NULL;
+    // Ancestors from the root down, each up to the next heading
+    int count = 0;
+    for (int i = scan.sections[scan.target].parent; i >= 0; i = scan.sections[i].parent) {
+        count++;
+    }
+    int *ranges   = safe_malloc((count + 1) * sizeof(int));
+    ranges[count] = scan.target;
+    for (int i = scan.sections[scan.target].parent, n = count; i >= 0; i = scan.sections[i].parent) {
+        ranges[--n] = i;
     }
 
-    // Allocate buffer and read file
-    char *buffer = calloc(size + 1, 1); // Use calloc to ensure zero initialization
-    if (!buffer) {
-        fclose(fp);
-        error("Memory allocation failed\n");
-        return NULL;
+    size_t parsed = 0;
+    *result       = 0;
+    for (int i = 0; i <= count && *result == 0; i++) {
+        size_t start = scan.sections[ranges[i]].offset;
+        size_t end   = i < count ? scan.sections[ranges[i] + 1].offset : scan.target_end;
+        *result      = md_parser_parse(parser, data->source + start, end - start, data);
+        parsed += end - start;
     }
+    info("Parsed %zu of %zu bytes in %d sections\n", parsed, data->source_size, count + 1);
 
-    size_t bytes_read  = fread(buffer, 1, size, fp);
-    buffer[bytes_read] = '\0';
-    fclose(fp);
+    data->doc->is_partial = 1;
+    free(ranges);
+    md_scan_free(&scan);
+    return 0;
+}
 
-    if (bytes_read == 0) {
-        free(buffer);
-        error("Failed to read file\n");
-        return NULL;
+// Parse stdin while it is read, so the blocks are processed as they arrive
+// and only the unfinished ones are kept. The text views are all copied into
+// the arena, there is no source to point into. Returns the md4c result and
+// the bytes read in size.
+static int md_parse_stream(MD_PARSER_CTX *parser, CallbackData *data, size_t *size) {
+    char *chunk  = safe_malloc(SOURCE_READ_CHUNK);
+    int   result = 0;
+
+    *size = 0;
+    while (1) {
+        ssize_t n = read(STDIN_FILENO, chunk, SOURCE_READ_CHUNK);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error("Failed to read -\n");
+            result = -1;
+            break;
+        }
+        if (n == 0) {
+            result = md_parser_finish(parser, data);
+            break;
+        }
+        *size += n;
+
+        // Stops reading once the requested section is complete
+        result = md_parser_feed(parser, chunk, n, data);
+        if (result < 0) {
+            break;
+        }
     }
 
+    free(chunk);
+    return result;
+}
+
+// Parse file_path. When heading is given, parsing stops after the first
+// section with that heading and the document only covers the part before.
+MD_DOCUMENT *md_parse_file(char *file_path, const char *heading) {
+    MD_SOURCE source    = {0};
+    int       is_stream = md_source_is_stream(file_path);
+    if (!is_stream) {
+        if (md_source_load(&source, file_path, !heading) != 0) {
+            return NULL;
+        }
+        info("Loaded %zu bytes (%s)\n", source.size, source.is_mapped ? "mapped" : "read");
+    }
+
+    MD_DOCUMENT *doc = safe_malloc(sizeof(MD_DOCUMENT));
+    memset(doc, 0, sizeof(MD_DOCUMENT));
+    doc->source = source;
+
     // Initialize callback data
-    CallbackData data = {.depth = 0};
+    CallbackData data = {.depth = 0, .doc = doc, .arena = &doc->arena, .source = source.data, .source_size = source.size, .target = heading};
 
     // Initialize parser with complete callback structure
     MD_PARSER parser   = {0}; // Zero initialize all fields
-    parser.abi_version = 0;
+    parser.abi_version = MD_PARSER_ABI_PLAIN;
     parser.flags       = MD_DIALECT_GITHUB;
     parser.enter_block = enter_block_callback;
     parser.leave_block = leave_block_callback;
     parser.enter_span  = enter_span_callback;
     parser.leave_span  = leave_span_callback;
     parser.text        = text_callback;
+    parser.plain_text  = plain_text_callback;
+
+    // One context for all the ranges md_parse_section() parses
+    MD_PARSER_CTX *ctx = md_parser_new(&parser);
+    if (!ctx) {
+        error("Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
 
-    int result = md_parse(buffer, bytes_read, &parser, &data);
+    int    result = -1;
+    size_t size   = source.size;
+    if (is_stream) {
+        result = md_parse_stream(ctx, &data, &size);
+        info("Streamed %zu bytes\n", size);
+    } else if (!heading || md_parse_section(ctx, &data, heading, &result) != 0) {
+        result = md_parser_parse(ctx, source.data, source.size, &data);
+    }
+    md_parser_free(ctx);
 
-    if (result != 0) {
+    if (result == STOP_PARSING && data.target_node) {
+        info("Stopped parsing after section: %s\n", heading);
+        doc->is_partial = 1;
+    } else if (result != 0) {
         error("Error: Markdown parsing failed with code %d\n", result);
         // } else {
         //     info("Parsing completed successfully\n");
     }
 
-    free(buffer);
-    return data.root;
+    buffer_free(&data.content);
+    table_free(&data.table);
+
+    if (size == 0) {
+        error("Empty file\n");
+        arena_free(&doc->arena);
+        free(doc);
+        return NULL;
+    }
+
+    doc->root = data.root;
+    md_build_nodes(doc);
+    info("Parsed %zu objects, %zu bytes in %zu chunks (%zu bytes reserved)\n",
+         doc->arena.objects, doc->arena.bytes, doc->arena.chunks, doc->arena.reserved);
+    return doc;
 }
 
-Tree *md_to_tree(MD_NODE *head, Tree *parent) {
-    MD_NODE *current = head;
+void md_free_document(MD_DOCUMENT *doc) {
+    if (!doc) {
+        return;
+    }
+    arena_free(&doc->arena);
+    md_source_free(&doc->source);
+    free(doc->index);
+    free(doc);
+}
 
-    while (current != NULL) {
-        Tree *current_tree = new_tree(current->text);
-        add_subtree(parent, current_tree);
+static int md_count_nodes(MD_NODE *node) {
+    int count = 0;
+    for (; node; node = node->next) {
+        count += 1 + md_count_nodes(node->child);
+    }
+    return count;
+}
 
-        if (current->child) {
-            md_to_tree(current->child, current_tree);
+// Number node and its following siblings in document order, returning the
+// index of node
+static int md_add_nodes(MD_NODES *nodes, MD_NODE *node, int parent) {
+    int first = MD_NODE_NONE;
+    int prev  = MD_NODE_NONE;
+
+    for (; node; node = node->next) {
+        int i                  = nodes->count++;
+        nodes->level[i]        = node->level;
+        nodes->is_command[i]   = node->code_block || node->child;
+        nodes->parent[i]       = parent;
+        nodes->next_sibling[i] = MD_NODE_NONE;
+        nodes->text[i]         = node->text;
+        nodes->node[i]         = node;
+        node->index            = i;
+
+        if (prev != MD_NODE_NONE) {
+            nodes->next_sibling[prev] = i;
+        } else {
+            first = i;
         }
+        nodes->first_child[i] = md_add_nodes(nodes, node->child, i);
+        nodes->end[i]         = nodes->count;
+        prev                  = i;
+    }
+    return first;
+}
+
+void md_build_nodes(MD_DOCUMENT *doc) {
+    MD_NODES *nodes = &doc->nodes;
+    ARENA    *arena = &doc->arena;
+    int       count = md_count_nodes(doc->root);
+
+    nodes->count        = 0;
+    nodes->level        = arena_alloc(arena, count);
+    nodes->is_command   = arena_alloc(arena, count);
+    nodes->parent       = arena_alloc(arena, count * sizeof(int));
+    nodes->first_child  = arena_alloc(arena, count * sizeof(int));
+    nodes->next_sibling = arena_alloc(arena, count * sizeof(int));
+    nodes->end          = arena_alloc(arena, count * sizeof(int));
+    nodes->text         = arena_alloc(arena, count * sizeof(MD_TEXT));
+    nodes->node         = arena_alloc(arena, count * sizeof(MD_NODE *));
+    md_add_nodes(nodes, doc->root, MD_NODE_NONE);
+}
 
-        current = current->next;
+// Heading name as shown in the hints, sub-commands are in lower case
+static char *md_command_name(MD_NODES *nodes, int i) {
+    char *name = strndup(nodes->text[i].ptr ? nodes->text[i].ptr : "", nodes->text[i].size);
+    if (nodes->level[i] > 1) {
+        for (int j = 0; name[j]; j++) {
+            name[j] = tolower(name[j]);
+        }
+    }
+    return name;
+}
+
+Tree *md_to_tree(MD_DOCUMENT *doc, int head, Tree *parent) {
+    MD_NODES *nodes = &doc->nodes;
+
+    for (int i = head; i != MD_NODE_NONE; i = nodes->next_sibling[i]) {
+        char *text         = strndup(nodes->text[i].ptr ? nodes->text[i].ptr : "", nodes->text[i].size);
+        Tree *current_tree = new_tree(text);
+        add_subtree(parent, current_tree);
+        free(text);
+
+        if (nodes->first_child[i] != MD_NODE_NONE) {
+            md_to_tree(doc, nodes->first_child[i], current_tree);
+        }
     }
 
     return parent;
 }
 
-Tree *md_to_command_tree(MD_NODE *head, Tree *parent) {
-    MD_NODE *current = head;
+Tree *md_to_command_tree(MD_DOCUMENT *doc, int head, Tree *parent) {
+    MD_NODES *nodes = &doc->nodes;
 
-    while (current != NULL) {
-        if (current->code_block || current->child) {
-            if (current->level > 1) {
-                current->text = strlower(current->text);
-            }
-            Tree *current_tree = new_tree(current->text);
+    for (int i = head; i != MD_NODE_NONE; i = nodes->next_sibling[i]) {
+        if (nodes->is_command[i]) {
+            char *name         = md_command_name(nodes, i);
+            Tree *current_tree = new_tree(name);
             add_subtree(parent, current_tree);
+            free(name);
 
-            if (current->child) {
-                md_to_command_tree(current->child, current_tree);
+            if (nodes->first_child[i] != MD_NODE_NONE) {
+                md_to_command_tree(doc, nodes->first_child[i], current_tree);
             }
         }
-
-        current = current->next;
     }
 
     return parent;
 }
 
-Tree *md_to_command_tree2(MD_NODE *head, Tree *parent, int max_len) {
-    MD_NODE *current = head;
+Tree *md_to_command_tree2(MD_DOCUMENT *doc, int head, Tree *parent, int max_len) {
+    MD_NODES *nodes = &doc->nodes;
 
-    while (current != NULL) {
-        if (current->code_block || current->child) {
-            if (current->level > 1) {
-                current->text = strlower(current->text);
-            }
-
-            size_t text_len    = strlen(current->text);
-            char  *description = current->description ? current->description : "";
-            size_t desc_len    = strlen(description);
-            int    space_count = max_len - (int)text_len - (current->level - 1) * 4;
+    for (int i = head; i != MD_NODE_NONE; i = nodes->next_sibling[i]) {
+        if (nodes->is_command[i]) {
+            MD_TEXT description = nodes->node[i]->description;
+            char   *name        = md_command_name(nodes, i);
+            int     space_count = max_len - (int)nodes->text[i].size - (nodes->level[i] - 1) * 4;
 
             if (space_count < 0) {
                 space_count = 0;
@@ -596,167 +965,142 @@ Tree *md_to_command_tree2(MD_NODE *head, Tree *parent, int max_len) {
             memset(space, ' ', space_count);
             space[space_count] = '\0';
 
-            int   buf_size = snprintf(NULL, 0, "%s%s  %s", current->text, space, description) + 1;
+            int   buf_size = snprintf(NULL, 0, "%s%s  %.*s", name, space, MD_TEXT_ARG(description)) + 1;
             char *buf      = safe_malloc(buf_size);
-            snprintf(buf, buf_size, "%s%s  %s", current->text, space, description);
+            snprintf(buf, buf_size, "%s%s  %.*s", name, space, MD_TEXT_ARG(description));
 
             Tree *current_tree = new_tree(buf);
             add_subtree(parent, current_tree);
 
-            if (current->child) {
-                md_to_command_tree2(current->child, current_tree, max_len);
+            if (nodes->first_child[i] != MD_NODE_NONE) {
+                md_to_command_tree2(doc, nodes->first_child[i], current_tree, max_len);
             }
 
             free(buf);
             free(space);
+            free(name);
         }
-
-        current = current->next;
     }
 
     return parent;
 }
 
-MD_NODE *md_find_node(MD_NODE *head, char *heading) {
-    if (head == NULL) {
+// Find the first heading in document order among head, its following
+// siblings and their subsections, ignoring case. Those are the nodes up to
+// the end of the parent's subtree.
+MD_NODE *md_find_node(MD_DOCUMENT *doc, int head, const char *heading) {
+    if (head == MD_NODE_NONE) {
         return NULL;
     }
 
-    MD_NODE *current = head;
-    while (current) {
-        if (strcasecmp(current->text, heading) == 0) {
-            return current;
-        }
-        MD_NODE *result = md_find_node(current->child, heading);
-        if (result) {
-            return result;
+    MD_NODES *nodes  = &doc->nodes;
+    int       parent = nodes->parent[head];
+    int       end    = parent == MD_NODE_NONE ? nodes->count : nodes->end[parent];
+    size_t    len    = strlen(heading);
+
+    for (int i = head; i < end; i++) {
+        const MD_TEXT *text = &nodes->text[i];
+        if (text->size == len && text->ptr && strncasecmp(text->ptr, heading, len) == 0) {
+            return nodes->node[i];
         }
-        current = current->next;
     }
 
-    return current;
+    return NULL;
 }
 
-
-// Convert MD_NODE into markdown string
-char *md_node_to_markdown(MD_NODE *node) {
-    if (!node) {
-        return strdup("");
+// Find the first heading in document order, ignoring case
+MD_NODE *md_find_heading(MD_DOCUMENT *doc, const char *heading) {
+    if (!doc->index_capacity) {
+        return NULL;
     }
 
-    // Calculate buffer size needed
-    size_t buffer_size = 1024; // Start with a reasonable size
-    char  *buffer      = safe_malloc(buffer_size);
-    if (!buffer) {
-        return NULL;
+    size_t len  = strlen(heading);
+    size_t mask = doc->index_capacity - 1;
+    size_t slot = md_index_hash(heading, len) & mask;
+    while (doc->index[slot]) {
+        MD_NODE *node = doc->index[slot];
+        if (md_text_case_equal(&node->text, heading)) {
+            return node;
+        }
+        slot = (slot + 1) & mask;
     }
-    buffer[0]         = '\0';
-    size_t buffer_len = 0;
+    return NULL;
+}
+
+static void md_buffer_printf(BUFFER *buffer, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+
+    char *str = safe_malloc(len + 1);
+    va_start(args, format);
+    vsnprintf(str, len + 1, format, args);
+    va_end(args);
+
+    buffer_append(buffer, str, len);
+    free(str);
+}
+
+// Markdown of the nodes in [start, end)
+static char *md_range_to_markdown(MD_DOCUMENT *doc, int start, int end) {
+    BUFFER buffer = {0};
+    buffer_append(&buffer, "", 0);
+
+    for (int i = start; i < end; i++) {
+        MD_NODE *node = doc->nodes.node[i];
 
-    while (node) {
         // Add heading if present
-        if (node->level > 0 && node->text) {
-            char *prefix = calloc(node->level + 1, sizeof(char));
-            if (prefix) {
-                memset(prefix, '#', node->level);
-                size_t needed = strlen(prefix) + strlen(node->text) + 3;
-                if (buffer_len + needed >= buffer_size) {
-                    while (buffer_len + needed >= buffer_size) {
-                        buffer_size *= 2;
-                    }
-                    buffer = realloc(buffer, buffer_size);
-                }
-                if (buffer) {
-                    snprintf(buffer + buffer_len, buffer_size - buffer_len, "%s %s\n\n", prefix, node->text);
-                    buffer_len += strlen(buffer + buffer_len);
-                }
-                free(prefix);
-            }
+        if (node->level > 0 && node->text.ptr) {
+            md_buffer_printf(&buffer, "%.*s %.*s\n\n", node->level, "######", MD_TEXT_ARG(node->text));
         }
 
         // Add description if present
-        if (node->description) {
-            size_t needed = strlen(node->description) + 2;
-            if (buffer_len + needed >= buffer_size) {
-                while (buffer_len + needed >= buffer_size) {
-                    buffer_size *= 2;
-                }
-                buffer = realloc(buffer, buffer_size);
-            }
-            if (buffer) {
-                snprintf(buffer + buffer_len, buffer_size - buffer_len, "%s\n\n", node->description);
-                buffer_len += strlen(buffer + buffer_len);
-            }
+        if (node->description.ptr) {
+            md_buffer_printf(&buffer, "%.*s\n\n", MD_TEXT_ARG(node->description));
         }
 
         // Add environment variables if present
         ENV_ENTRY *env_entry = node->env_entry;
         if (env_entry) {
-            snprintf(buffer + buffer_len, buffer_size - buffer_len, "|key|value|\n|---|---|\n");
-            buffer_len += strlen(buffer + buffer_len);
-            while (env_entry) {
-                if (env_entry->key && env_entry->value) {
-                    size_t needed = strlen(env_entry->key) + strlen(env_entry->value) + 4;
-                    if (buffer_len + needed >= buffer_size) {
-                        while (buffer_len + needed >= buffer_size) {
-                            buffer_size *= 2;
-                        }
-                        buffer = realloc(buffer, buffer_size);
-                    }
-                    if (buffer) {
-                        snprintf(buffer + buffer_len, buffer_size - buffer_len, "|%s|%s|\n", env_entry->key, env_entry->value);
-                        buffer_len += strlen(buffer + buffer_len);
-                    }
+            md_buffer_printf(&buffer, "|key|value|\n|---|---|\n");
+            for (; env_entry; env_entry = env_entry->next) {
+                if (env_entry->key.ptr && env_entry->value.ptr) {
+                    md_buffer_printf(&buffer, "|%.*s|%.*s|\n", MD_TEXT_ARG(env_entry->key), MD_TEXT_ARG(env_entry->value));
                 }
-                env_entry = env_entry->next;
             }
-            snprintf(buffer + buffer_len, buffer_size - buffer_len, "\n");
-            buffer_len += strlen(buffer + buffer_len);
+            md_buffer_printf(&buffer, "\n");
         }
 
-        // Add code blocks if present
-        CODE_BLOCK *block = node->code_block;
-        while (block) {
-            if (block->info && block->content) {
-                // printf("content=%s\n", block->content);
-                size_t needed = strlen(block->info) + strlen(block->content) + 7;
-                if (buffer_len + needed >= buffer_size) {
-                    while (buffer_len + needed >= buffer_size) {
-                        buffer_size *= 2;
-                    }
-                    buffer = realloc(buffer, buffer_size);
-                }
-                if (buffer) {
-                    snprintf(buffer + buffer_len, buffer_size - buffer_len,
-                             "```%s\n%s```\n\n",
-                             block->info, block->content);
-                    buffer_len += strlen(buffer + buffer_len);
-                }
+        // Add dependencies if present
+        if (node->depends) {
+            md_buffer_printf(&buffer, "|depends|\n|---|\n");
+            for (DEPENDENCY *dep = node->depends; dep; dep = dep->next) {
+                md_buffer_printf(&buffer, "|%.*s|\n", MD_TEXT_ARG(dep->heading));
             }
-            block = block->next;
+            md_buffer_printf(&buffer, "\n");
         }
 
-        // Recursively process child nodes
-        if (node->child) {
-            char *child_content = md_node_to_markdown(node->child);
-            if (child_content) {
-                size_t needed = strlen(child_content);
-                if (buffer && buffer_len + needed >= buffer_size) {
-                    while (buffer_len + needed >= buffer_size) {
-                        buffer_size *= 2;
-                    }
-                    buffer = realloc(buffer, buffer_size);
-                }
-                if (buffer) {
-                    strcpy(buffer + buffer_len, child_content);
-                    buffer_len += needed;
-                }
-                free(child_content);
+        // Add code blocks if present
+        for (CODE_BLOCK *block = node->code_block; block; block = block->next) {
+            if (block->info.ptr && block->content.ptr) {
+                md_buffer_printf(&buffer, "```%.*s\n%.*s```\n\n", MD_TEXT_ARG(block->info), MD_TEXT_ARG(block->content));
             }
         }
+    }
 
-        node = node->next;
+    return buffer.data;
+}
+
+// Convert the node and its subsections into markdown string
+char *md_node_to_markdown(MD_DOCUMENT *doc, int node) {
+    if (node == MD_NODE_NONE) {
+        return strdup("");
     }
+    return md_range_to_markdown(doc, node, doc->nodes.end[node]);
+}
 
-    return buffer;
-}
\ No newline at end of file
+// Convert every node reachable from the root into markdown string
+char *md_document_to_markdown(MD_DOCUMENT *doc) {
+    return md_range_to_markdown(doc, 0, doc->nodes.count);
+}
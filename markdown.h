@@ -2,65 +2,153 @@
 #ifndef MARKDOWN_H
 #define MARKDOWN_H
 
+#include "arena.h"
 #include "md4c/md4c.h"
+#include "source.h"
 #include "tree/tree.h"
 
+// Text view. Points into the retained document source unless the text
+// differs from it (entities, joined lines), in which case it was
+// materialized into the document arena. Views are not NUL-terminated,
+// use md_cstr() where a C string is needed.
+typedef struct MD_TEXT MD_TEXT;
+struct MD_TEXT {
+    const char *ptr;
+    unsigned    size;
+    unsigned    is_cstr;
+};
+
+// Arguments for a "%.*s" conversion
+#define MD_TEXT_ARG(text) (int)(text).size, ((text).ptr ? (text).ptr : "")
+
 // Code block structure
 typedef struct CODE_BLOCK CODE_BLOCK;
 struct CODE_BLOCK {
-    char       *info;
-    char       *content;
+    MD_TEXT     info;
+    MD_TEXT     content;
     CODE_BLOCK *next;
 };
 
-CODE_BLOCK *new_code_block(char *info);
+CODE_BLOCK *new_code_block(ARENA *arena, MD_TEXT info);
 
-// Table structure
+// Table structure. The cells are one array, row by row with the head rows
+// first, reused from table to table while parsing.
 typedef struct TABLE TABLE;
 struct TABLE {
     unsigned col_count;
     unsigned head_row_count;
     unsigned body_row_count;
-    char  ***head;
-    char  ***body;
+    MD_TEXT *cells;
+    size_t   capacity; // Cells allocated
 };
 
-TABLE *new_table(unsigned col_count, unsigned head_row_count, unsigned body_row_count);
+#define TABLE_HEAD(table, row, col) ((table)->cells[(size_t)(row) * (table)->col_count + (col)])
+#define TABLE_BODY(table, row, col) TABLE_HEAD(table, (table)->head_row_count + (row), col)
+
+void table_reset(TABLE *table, unsigned col_count, unsigned head_row_count, unsigned body_row_count);
+void table_free(TABLE *table);
 
 // Environment variable entry
 typedef struct ENV_ENTRY ENV_ENTRY;
 struct ENV_ENTRY {
-    char      *key;
-    char      *value;
+    MD_TEXT    key;
+    MD_TEXT    value;
     ENV_ENTRY *next;
 };
 
+// Heading named in a depends table, run before the heading of the section
+typedef struct DEPENDENCY DEPENDENCY;
+struct DEPENDENCY {
+    MD_TEXT     heading;
+    DEPENDENCY *next;
+};
+
 // Markdown AST node structure
 typedef struct MD_NODE MD_NODE;
 struct MD_NODE {
     int         level;
-    char       *text;
-    char       *description;
+    MD_TEXT     text;
+    MD_TEXT     description;
     CODE_BLOCK *code_block;
+    CODE_BLOCK *code_block_tail;
     ENV_ENTRY  *env_entry;
+    ENV_ENTRY  *env_entry_tail;
+    DEPENDENCY *depends;
+    DEPENDENCY *depends_tail;
+    char      **envp; // Built by node_envp() when the node runs
     MD_NODE    *next;
     MD_NODE    *parent;
     MD_NODE    *child;
+    int         is_orphan; // Not reachable from the root, see MD_BLOCK_H
+    int         index;     // Position in MD_DOCUMENT.nodes, MD_NODE_NONE for orphans
 };
 
-MD_NODE *new_md_node();
+MD_NODE *new_md_node(ARENA *arena);
+
+#define MD_NODE_NONE (-1)
+
+// The nodes reachable from the root as parallel arrays in document order,
+// which the traversals scan instead of chasing the node pointers. Links are
+// node indexes and the subtree of node i is [i, end[i]). node[i] is the
+// linked view of node i.
+typedef struct MD_NODES MD_NODES;
+struct MD_NODES {
+    int            count;
+    unsigned char *level;
+    unsigned char *is_command; // Has code blocks or subsections
+    int           *parent;
+    int           *first_child;
+    int           *next_sibling;
+    int           *end;
+    MD_TEXT       *text;
+    MD_NODE      **node;
+};
+
+// Parsed document, owns every node, code block, env entry and string
+typedef struct MD_DOCUMENT MD_DOCUMENT;
+struct MD_DOCUMENT {
+    MD_NODE *root;
+    MD_NODES nodes;
+    ARENA    arena;
+
+    // Source the text views point into
+    MD_SOURCE source;
+
+    // Parsing stopped after the requested section, see md_parse_file()
+    int is_partial;
+
+    // Case-folded heading text to node, the first heading in document
+    // order wins
+    MD_NODE **index;
+    size_t    index_capacity;
+    size_t    index_count;
+};
 
 // Print AST
 void md_print_ast(MD_NODE *node, int depth);
 
 // Parse markdown file
-MD_NODE *md_parse_file(char *file_path);
-
-// Convert MD_NODE to Tree
-Tree    *md_to_tree(MD_NODE *head, Tree *parent);
-Tree    *md_to_command_tree(MD_NODE *head, Tree *parent);
-Tree    *md_to_command_tree2(MD_NODE *head, Tree *parent, int max_len);
-MD_NODE *md_find_node(MD_NODE *head, char *heading);
-char    *md_node_to_markdown(MD_NODE *node);
+MD_DOCUMENT *md_parse_file(char *file_path, const char *heading);
+void         md_free_document(MD_DOCUMENT *doc);
+
+// Text helpers
+const char *md_cstr(MD_DOCUMENT *doc, MD_TEXT *text);
+int         md_text_equal(const MD_TEXT *text, const char *str);
+int         md_text_case_equal(const MD_TEXT *text, const char *str);
+void        md_detach_node(MD_DOCUMENT *doc, MD_NODE *node);
+
+// Flatten the tree below doc->root into doc->nodes
+void md_build_nodes(MD_DOCUMENT *doc);
+
+// Convert the node at index head and its following siblings to Tree
+Tree    *md_to_tree(MD_DOCUMENT *doc, int head, Tree *parent);
+Tree    *md_to_command_tree(MD_DOCUMENT *doc, int head, Tree *parent);
+Tree    *md_to_command_tree2(MD_DOCUMENT *doc, int head, Tree *parent, int max_len);
+MD_NODE *md_find_node(MD_DOCUMENT *doc, int head, const char *heading);
+MD_NODE *md_find_heading(MD_DOCUMENT *doc, const char *heading);
+void     md_index_insert(MD_DOCUMENT *doc, MD_NODE *node);
+size_t   md_index_hash(const char *str, size_t len);
+char    *md_node_to_markdown(MD_DOCUMENT *doc, int node);
+char    *md_document_to_markdown(MD_DOCUMENT *doc);
 
 #endif
\ No newline at end of file
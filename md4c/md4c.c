@@ -26,11 +26,18 @@
 #include "md4c.h"
 
 #include <limits.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+/* Vectorized scanning, see md_skip_to_mark() and md_scan_lines(). */
+#if !defined MD4C_USE_UTF16 && defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+    #define MD4C_SIMD
+    #include <immintrin.h>
+#endif
+
 
 /*****************************
  ***  Miscellaneous Stuff  ***
@@ -162,6 +169,30 @@ struct MD_MARKSTACK_tag {
     int top;        /* -1 if empty. */
 };
 
+/* Extent of a container block in the input, see md_analyze_container_sources(). */
+typedef struct MD_CONTAINER_SOURCE_tag MD_CONTAINER_SOURCE;
+struct MD_CONTAINER_SOURCE_tag {
+    OFF beg;
+    OFF end;
+    OFF content_beg;
+    int parent;     /* Index of the enclosing container, -1 if none. */
+};
+
+/* State of a document pushed with md_parser_feed(), see md_feed_lines(). */
+typedef struct MD_FEED_tag MD_FEED;
+
+/* Where a line ends and how it is indented, found ahead of md_analyze_line()
+ * for a batch of lines at once. */
+#define MD_LINE_BREAK_BATCH     128
+
+typedef struct MD_LINE_BREAK_tag MD_LINE_BREAK;
+struct MD_LINE_BREAK_tag {
+    OFF beg;
+    OFF indent_end;     /* First non-blank character. */
+    OFF end;            /* The line break, or end of the document. */
+    unsigned indent;
+};
+
 /* Context propagated through all the parsing. */
 typedef struct MD_CTX_tag MD_CTX;
 struct MD_CTX_tag {
@@ -200,6 +231,18 @@ struct MD_CTX_tag {
     char mark_char_map[256];
 #endif
 
+#ifdef MD4C_SIMD
+    /* Vector instructions to use (MD_SIMD_xxx), and the mark set as a nibble
+     * table for md_skip_to_mark_avx2(). */
+    int simd;
+    unsigned char mark_nibbles[16];
+#endif
+
+    /* Lines ahead of md_analyze_line(), see md_scan_lines(). */
+    MD_LINE_BREAK line_breaks[MD_LINE_BREAK_BATCH];
+    int n_line_breaks;
+    int line_break_index;
+
     /* For resolving of inline spans. */
     MD_MARKSTACK opener_stacks[16];
 #define ASTERISK_OPENERS_oo_mod3_0      (ctx->opener_stacks[0])     /* Opener-only */
@@ -229,6 +272,28 @@ struct MD_CTX_tag {
     int table_cell_boundaries_head;
     int table_cell_boundaries_tail;
 
+    /* Scratch of md_process_table_block_contents() and md_process_table_row(),
+     * kept so that tables and their rows do not allocate each time. */
+    MD_ALIGN* table_align;
+    int alloc_table_align;
+    OFF* table_pipe_offs;
+    int alloc_table_pipe_offs;
+
+    /* For MD_PARSER::block_source: Offsets where the lines of the document
+     * start, built on first use, and the extents of the container blocks in
+     * the order of their openers. */
+    OFF* line_starts;
+    int n_line_starts;
+    int alloc_line_starts;
+    MD_CONTAINER_SOURCE* container_sources;
+    int n_container_sources;
+    int alloc_container_sources;
+
+    /* Where ctx->text is in the whole input, when it is fed in chunks. The
+     * line is only counted for MD_PARSER::block_source. */
+    OFF source_base;
+    unsigned source_base_line;
+
     /* For resolving links. */
     int unresolved_link_head;
     int unresolved_link_tail;
@@ -264,6 +329,10 @@ struct MD_CTX_tag {
     int html_block_type;    /* For checking closing raw HTML condition. */
     int last_line_has_list_loosening_effect;
     int last_list_item_starts_with_two_blank_lines;
+
+    /* For md_parser_feed(). Allocated on first use and kept like the other
+     * buffers. */
+    MD_FEED* feed;
 };
 
 enum MD_LINETYPE_tag {
@@ -286,11 +355,30 @@ struct MD_LINE_ANALYSIS_tag {
     MD_LINETYPE type;
     unsigned data;
     int enforce_new_block;
+    int is_closing_fence;   /* MD_LINE_BLANK which closes a fenced code block. */
     OFF beg;
     OFF end;
     unsigned indent;        /* Indentation level. */
 };
 
+struct MD_FEED_tag {
+    /* Input not emitted yet, from buffer + text_off (i.e. ctx->text) to
+     * buffer + size. Whatever is before text_off is dropped on the next
+     * md_parser_feed(). */
+    CHAR* buffer;
+    SZ alloc_buffer;
+    SZ size;
+    OFF text_off;
+
+    /* Next line to analyze, relative to ctx->text, and the line state
+     * md_process_doc() keeps in its locals. */
+    OFF off;
+    MD_LINE_ANALYSIS line_buf[2];
+    const MD_LINE_ANALYSIS* pivot_line;
+
+    int is_open;    /* MD_BLOCK_DOC has been entered. */
+};
+
 typedef struct MD_LINE_tag MD_LINE;
 struct MD_LINE_tag {
     OFF beg;
@@ -313,6 +401,28 @@ struct MD_VERBATIMLINE_tag {
 #define CH(off)                 (ctx->text[(off)])
 #define STR(off)                (ctx->text + (off))
 
+/* Vector instructions for the hot scanning loops. */
+#define MD_SIMD_SCALAR          0
+#define MD_SIMD_SSE2            1
+#define MD_SIMD_AVX2            2
+
+#ifdef MD4C_SIMD
+/* Highest variant md_simd_level() may pick. Tests lower it to compare the
+ * variants. */
+static int md_simd_max = MD_SIMD_AVX2;
+
+/* The best variant supported by the CPU. */
+static int
+md_simd_level(void)
+{
+    if(md_simd_max >= MD_SIMD_AVX2  &&  __builtin_cpu_supports("avx2"))
+        return MD_SIMD_AVX2;
+    if(md_simd_max >= MD_SIMD_SSE2  &&  __builtin_cpu_supports("sse2"))
+        return MD_SIMD_SSE2;
+    return MD_SIMD_SCALAR;
+}
+#endif
+
 /* Character classification.
  * Note we assume ASCII compatibility of code points < 128 here. */
 #define ISIN_(ch, ch_min, ch_max)       ((ch_min) <= (unsigned)(ch) && (unsigned)(ch) <= (ch_max))
@@ -420,13 +530,43 @@ md_text_with_null_replacement(MD_CTX* ctx, MD_TEXTTYPE type, const CHAR* str, SZ
     } while(0)
 
 
+/* Memory management. All memory of the parser goes through these, so the
+ * application may route it to its own allocator, see MD_PARSER::mem_alloc. */
+static inline void*
+md_malloc(MD_CTX* ctx, size_t size)
+{
+    if(ctx->parser.mem_alloc != NULL)
+        return ctx->parser.mem_alloc(size, ctx->parser.mem_userdata);
+    return malloc(size);
+}
+
+static inline void*
+md_realloc(MD_CTX* ctx, void* ptr, size_t old_size, size_t new_size)
+{
+    if(ctx->parser.mem_alloc != NULL)
+        return ctx->parser.mem_realloc(ptr, old_size, new_size, ctx->parser.mem_userdata);
+    return realloc(ptr, new_size);
+}
+
+static inline void
+md_free(MD_CTX* ctx, void* ptr)
+{
+    if(ctx->parser.mem_alloc != NULL) {
+        if(ptr != NULL)
+            ctx->parser.mem_free(ptr, ctx->parser.mem_userdata);
+        return;
+    }
+    free(ptr);
+}
+
 #define MD_TEMP_BUFFER(sz)                                                  \
     do {                                                                    \
         if(sz > ctx->alloc_buffer) {                                        \
             CHAR* new_buffer;                                               \
             SZ new_size = ((sz) + (sz) / 2 + 128) & ~127;                   \
                                                                             \
-            new_buffer = realloc(ctx->buffer, new_size);                    \
+            new_buffer = md_realloc(ctx, ctx->buffer, ctx->alloc_buffer,    \
+                                    new_size);                              \
             if(new_buffer == NULL) {                                        \
                 MD_LOG("realloc() failed.");                                \
                 ret = -1;                                                   \
@@ -1032,7 +1172,7 @@ md_merge_lines_alloc(MD_CTX* ctx, OFF beg, OFF end, const MD_LINE* lines, MD_SIZ
 {
     CHAR* buffer;
 
-    buffer = (CHAR*) malloc(sizeof(CHAR) * (end - beg));
+    buffer = (CHAR*) md_malloc(ctx, sizeof(CHAR) * (end - beg));
     if(buffer == NULL) {
         MD_LOG("malloc() failed.");
         return -1;
@@ -1430,22 +1570,25 @@ md_build_attr_append_substr(MD_CTX* ctx, MD_ATTRIBUTE_BUILD* build,
     if(build->substr_count >= build->substr_alloc) {
         MD_TEXTTYPE* new_substr_types;
         OFF* new_substr_offsets;
+        int old_alloc = build->substr_alloc;
 
         build->substr_alloc = (build->substr_alloc > 0
                 ? build->substr_alloc + build->substr_alloc / 2
                 : 8);
-        new_substr_types = (MD_TEXTTYPE*) realloc(build->substr_types,
+        new_substr_types = (MD_TEXTTYPE*) md_realloc(ctx, build->substr_types,
+                                    old_alloc * sizeof(MD_TEXTTYPE),
                                     build->substr_alloc * sizeof(MD_TEXTTYPE));
         if(new_substr_types == NULL) {
             MD_LOG("realloc() failed.");
             return -1;
         }
         /* Note +1 to reserve space for final offset (== raw_size). */
-        new_substr_offsets = (OFF*) realloc(build->substr_offsets,
+        new_substr_offsets = (OFF*) md_realloc(ctx, build->substr_offsets,
+                                    (old_alloc > 0 ? old_alloc+1 : 0) * sizeof(OFF),
                                     (build->substr_alloc+1) * sizeof(OFF));
         if(new_substr_offsets == NULL) {
             MD_LOG("realloc() failed.");
-            free(new_substr_types);
+            md_free(ctx, new_substr_types);
             return -1;
         }
 
@@ -1462,12 +1605,10 @@ md_build_attr_append_substr(MD_CTX* ctx, MD_ATTRIBUTE_BUILD* build,
 static void
 md_free_attribute(MD_CTX* ctx, MD_ATTRIBUTE_BUILD* build)
 {
-    MD_UNUSED(ctx);
-
     if(build->substr_alloc > 0) {
-        free(build->text);
-        free(build->substr_types);
-        free(build->substr_offsets);
+        md_free(ctx, build->text);
+        md_free(ctx, build->substr_types);
+        md_free(ctx, build->substr_offsets);
     }
 }
 
@@ -1502,7 +1643,7 @@ md_build_attribute(MD_CTX* ctx, const CHAR* raw_text, SZ raw_size,
         build->trivial_offsets[1] = raw_size;
         off = raw_size;
     } else {
-        build->text = (CHAR*) malloc(raw_size * sizeof(CHAR));
+        build->text = (CHAR*) md_malloc(ctx, raw_size * sizeof(CHAR));
         if(build->text == NULL) {
             MD_LOG("malloc() failed.");
             goto abort;
@@ -1746,7 +1887,7 @@ md_build_ref_def_hashtable(MD_CTX* ctx)
         return 0;
 
     ctx->ref_def_hashtable_size = (ctx->n_ref_defs * 5) / 4;
-    ctx->ref_def_hashtable = malloc(ctx->ref_def_hashtable_size * sizeof(void*));
+    ctx->ref_def_hashtable = md_malloc(ctx, ctx->ref_def_hashtable_size * sizeof(void*));
     if(ctx->ref_def_hashtable == NULL) {
         MD_LOG("malloc() failed.");
         goto abort;
@@ -1785,7 +1926,7 @@ md_build_ref_def_hashtable(MD_CTX* ctx)
             }
 
             /* Make the bucket complex, i.e. able to hold more ref. defs. */
-            list = (MD_REF_DEF_LIST*) malloc(sizeof(MD_REF_DEF_LIST) + 2 * sizeof(MD_REF_DEF*));
+            list = (MD_REF_DEF_LIST*) md_malloc(ctx, sizeof(MD_REF_DEF_LIST) + 2 * sizeof(MD_REF_DEF*));
             if(list == NULL) {
                 MD_LOG("malloc() failed.");
                 goto abort;
@@ -1807,7 +1948,8 @@ md_build_ref_def_hashtable(MD_CTX* ctx)
         list = (MD_REF_DEF_LIST*) bucket;
         if(list->n_ref_defs >= list->alloc_ref_defs) {
             int alloc_ref_defs = list->alloc_ref_defs + list->alloc_ref_defs / 2;
-            MD_REF_DEF_LIST* list_tmp = (MD_REF_DEF_LIST*) realloc(list,
+            MD_REF_DEF_LIST* list_tmp = (MD_REF_DEF_LIST*) md_realloc(ctx, list,
+                        sizeof(MD_REF_DEF_LIST) + list->alloc_ref_defs * sizeof(MD_REF_DEF*),
                         sizeof(MD_REF_DEF_LIST) + alloc_ref_defs * sizeof(MD_REF_DEF*));
             if(list_tmp == NULL) {
                 MD_LOG("realloc() failed.");
@@ -1863,10 +2005,10 @@ md_free_ref_def_hashtable(MD_CTX* ctx)
                 continue;
             if(ctx->ref_defs <= (MD_REF_DEF*) bucket  &&  (MD_REF_DEF*) bucket < ctx->ref_defs + ctx->n_ref_defs)
                 continue;
-            free(bucket);
+            md_free(ctx, bucket);
         }
 
-        free(ctx->ref_def_hashtable);
+        md_free(ctx, ctx->ref_def_hashtable);
     }
 }
 
@@ -2228,11 +2370,13 @@ md_is_link_reference_definition(MD_CTX* ctx, const MD_LINE* lines, MD_SIZE n_lin
     /* So, it _is_ a reference definition. Remember it. */
     if(ctx->n_ref_defs >= ctx->alloc_ref_defs) {
         MD_REF_DEF* new_defs;
+        int old_alloc = ctx->alloc_ref_defs;
 
         ctx->alloc_ref_defs = (ctx->alloc_ref_defs > 0
                 ? ctx->alloc_ref_defs + ctx->alloc_ref_defs / 2
                 : 16);
-        new_defs = (MD_REF_DEF*) realloc(ctx->ref_defs, ctx->alloc_ref_defs * sizeof(MD_REF_DEF));
+        new_defs = (MD_REF_DEF*) md_realloc(ctx, ctx->ref_defs, old_alloc * sizeof(MD_REF_DEF),
+                                            ctx->alloc_ref_defs * sizeof(MD_REF_DEF));
         if(new_defs == NULL) {
             MD_LOG("realloc() failed.");
             goto abort;
@@ -2273,9 +2417,9 @@ md_is_link_reference_definition(MD_CTX* ctx, const MD_LINE* lines, MD_SIZE n_lin
 abort:
     /* Failure. */
     if(def != NULL  &&  def->label_needs_free)
-        free(def->label);
+        md_free(ctx, def->label);
     if(def != NULL  &&  def->title_needs_free)
-        free(def->title);
+        md_free(ctx, def->title);
     return ret;
 }
 
@@ -2321,7 +2465,7 @@ md_is_link_reference(MD_CTX* ctx, const MD_LINE* lines, MD_SIZE n_lines,
     }
 
     if(is_multiline)
-        free(label);
+        md_free(ctx, label);
 
     if(def != NULL) {
         /* See https://github.com/mity/md4c/issues/238 */
@@ -2444,12 +2588,13 @@ md_free_ref_defs(MD_CTX* ctx)
         MD_REF_DEF* def = &ctx->ref_defs[i];
 
         if(def->label_needs_free)
-            free(def->label);
+            md_free(ctx, def->label);
         if(def->title_needs_free)
-            free(def->title);
+            md_free(ctx, def->title);
     }
 
-    free(ctx->ref_defs);
+    /* The array itself is kept for the next document, see md_free_ctx(). */
+    ctx->n_ref_defs = 0;
 }
 
 
@@ -2600,11 +2745,13 @@ md_add_mark(MD_CTX* ctx)
 {
     if(ctx->n_marks >= ctx->alloc_marks) {
         MD_MARK* new_marks;
+        int old_alloc = ctx->alloc_marks;
 
         ctx->alloc_marks = (ctx->alloc_marks > 0
                 ? ctx->alloc_marks + ctx->alloc_marks / 2
                 : 64);
-        new_marks = realloc(ctx->marks, ctx->alloc_marks * sizeof(MD_MARK));
+        new_marks = md_realloc(ctx, ctx->marks, old_alloc * sizeof(MD_MARK),
+                               ctx->alloc_marks * sizeof(MD_MARK));
         if(new_marks == NULL) {
             MD_LOG("realloc() failed.");
             return NULL;
@@ -2727,6 +2874,129 @@ md_rollback(MD_CTX* ctx, int opener_index, int closer_index, int how)
     }
 }
 
+/* Finding the next mark character.
+ *
+ * Most bytes of a line are plain text which md_collect_marks() only skips, so
+ * on x86 we test 16 (SSE2) or 32 (AVX2) bytes at once and jump right to the
+ * first candidate. The vector loads may run past the end of the line but never
+ * past the end of the document.
+ */
+
+#ifdef MD4C_USE_UTF16
+    /* For UTF-16, mark_char_map[] covers only ASCII. */
+    #define IS_MARK_CHAR(off)   ((CH(off) < SIZEOF_ARRAY(ctx->mark_char_map))  &&  \
+                                (ctx->mark_char_map[(unsigned char) CH(off)]))
+#else
+    /* For 8-bit encodings, mark_char_map[] covers all 256 elements. */
+    #define IS_MARK_CHAR(off)   (ctx->mark_char_map[(unsigned char) CH(off)])
+#endif
+
+static OFF
+md_skip_to_mark_scalar(MD_CTX* ctx, OFF off, OFF end)
+{
+    /* Optimization: Use some loop unrolling. */
+    while(off + 3 < end  &&  !IS_MARK_CHAR(off+0)  &&  !IS_MARK_CHAR(off+1)
+                         &&  !IS_MARK_CHAR(off+2)  &&  !IS_MARK_CHAR(off+3))
+        off += 4;
+    while(off < end  &&  !IS_MARK_CHAR(off+0))
+        off++;
+    return off;
+}
+
+#ifdef MD4C_SIMD
+
+static void
+md_build_mark_vectors(MD_CTX* ctx)
+{
+    int i;
+
+    /* All mark characters are ASCII. For AVX2, mark_nibbles[lo] has bit `hi`
+     * set for each mark character (hi << 4 | lo). */
+    memset(ctx->mark_nibbles, 0, sizeof(ctx->mark_nibbles));
+    for(i = 0; i < 128; i++) {
+        if(ctx->mark_char_map[i]) {
+            ctx->mark_nibbles[i & 0x0f] |= (unsigned char) (1 << (i >> 4));
+        }
+    }
+}
+
+/* SSE2 has no byte shuffle for a table lookup, so skip letters, digits and
+ * (unless it is a mark) space, which are most of a line, and check the other
+ * bytes against mark_char_map[]. */
+__attribute__((target("sse2")))
+static OFF
+md_skip_to_mark_sse2(MD_CTX* ctx, OFF off, OFF end)
+{
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+    const __m128i before_a = _mm_set1_epi8('a' - 1);
+    const __m128i after_z = _mm_set1_epi8('z' + 1);
+    const __m128i before_0 = _mm_set1_epi8('0' - 1);
+    const __m128i after_9 = _mm_set1_epi8('9' + 1);
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i space_is_plain = _mm_set1_epi8(ctx->mark_char_map[' '] ? 0 : -1);
+
+    while(off < end  &&  off + 16 <= ctx->size) {
+        __m128i data = _mm_loadu_si128((const __m128i*) (ctx->text + off));
+        __m128i folded = _mm_or_si128(data, case_bit);
+        __m128i plain = _mm_or_si128(
+                _mm_and_si128(_mm_cmpgt_epi8(folded, before_a), _mm_cmplt_epi8(folded, after_z)),
+                _mm_and_si128(_mm_cmpgt_epi8(data, before_0), _mm_cmplt_epi8(data, after_9)));
+        unsigned mask;
+
+        plain = _mm_or_si128(plain, _mm_and_si128(_mm_cmpeq_epi8(data, space), space_is_plain));
+        mask = ~(unsigned) _mm_movemask_epi8(plain) & 0xffff;
+        while(mask != 0) {
+            OFF tmp = off + (OFF) __builtin_ctz(mask);
+            if(tmp >= end)
+                return end;
+            if(IS_MARK_CHAR(tmp))
+                return tmp;
+            mask &= mask - 1;
+        }
+        off += 16;
+    }
+
+    return md_skip_to_mark_scalar(ctx, MIN(off, end), end);
+}
+
+__attribute__((target("avx2")))
+static OFF
+md_skip_to_mark_avx2(MD_CTX* ctx, OFF off, OFF end)
+{
+    const __m256i lo_table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) ctx->mark_nibbles));
+    const __m256i hi_table = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, (char) 128, 0, 0, 0, 0, 0, 0, 0, 0,
+                                              1, 2, 4, 8, 16, 32, 64, (char) 128, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+
+    while(off < end  &&  off + 32 <= ctx->size) {
+        __m256i data = _mm256_loadu_si256((const __m256i*) (ctx->text + off));
+        __m256i lo = _mm256_shuffle_epi8(lo_table, _mm256_and_si256(data, nibble));
+        __m256i hi = _mm256_shuffle_epi8(hi_table, _mm256_and_si256(_mm256_srli_epi16(data, 4), nibble));
+        unsigned mask = ~(unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(lo, hi), _mm256_setzero_si256()));
+
+        if(mask != 0)
+            return MIN(off + (OFF) __builtin_ctz(mask), end);
+        off += 32;
+    }
+
+    return md_skip_to_mark_scalar(ctx, MIN(off, end), end);
+}
+
+#endif  /* MD4C_SIMD */
+
+/* Returns offset of the first mark character in [off, end), or end. */
+static inline OFF
+md_skip_to_mark(MD_CTX* ctx, OFF off, OFF end)
+{
+#ifdef MD4C_SIMD
+    if(ctx->simd == MD_SIMD_AVX2)
+        return md_skip_to_mark_avx2(ctx, off, end);
+    if(ctx->simd == MD_SIMD_SSE2)
+        return md_skip_to_mark_sse2(ctx, off, end);
+#endif
+    return md_skip_to_mark_scalar(ctx, off, end);
+}
+
 static void
 md_build_mark_char_map(MD_CTX* ctx)
 {
@@ -2771,6 +3041,10 @@ md_build_mark_char_map(MD_CTX* ctx)
                 ctx->mark_char_map[i] = 1;
         }
     }
+
+#ifdef MD4C_SIMD
+    md_build_mark_vectors(ctx);
+#endif
 }
 
 static int
@@ -3016,22 +3290,7 @@ md_collect_marks(MD_CTX* ctx, const MD_LINE* lines, MD_SIZE n_lines, int table_m
         while(TRUE) {
             CHAR ch;
 
-#ifdef MD4C_USE_UTF16
-    /* For UTF-16, mark_char_map[] covers only ASCII. */
-    #define IS_MARK_CHAR(off)   ((CH(off) < SIZEOF_ARRAY(ctx->mark_char_map))  &&  \
-                                (ctx->mark_char_map[(unsigned char) CH(off)]))
-#else
-    /* For 8-bit encodings, mark_char_map[] covers all 256 elements. */
-    #define IS_MARK_CHAR(off)   (ctx->mark_char_map[(unsigned char) CH(off)])
-#endif
-
-            /* Optimization: Use some loop unrolling. */
-            while(off + 3 < line->end  &&  !IS_MARK_CHAR(off+0)  &&  !IS_MARK_CHAR(off+1)
-                                       &&  !IS_MARK_CHAR(off+2)  &&  !IS_MARK_CHAR(off+3))
-                off += 4;
-            while(off < line->end  &&  !IS_MARK_CHAR(off+0))
-                off++;
-
+            off = md_skip_to_mark(ctx, off, line->end);
             if(off >= line->end)
                 break;
 
@@ -3576,7 +3835,7 @@ md_resolve_links(MD_CTX* ctx, const MD_LINE* lines, MD_SIZE n_lines)
                             if(ctx->marks[mark->next].beg >= inline_link_end) {
                                 /* Cancel the link status. */
                                 if(attr.title_needs_free)
-                                    free(attr.title);
+                                    md_free(ctx, attr.title);
                                 is_link = FALSE;
                                 break;
                             }
@@ -4496,6 +4755,114 @@ abort:
 }
 
 
+/**************************
+ ***  Source Positions  ***
+ **************************/
+
+/* Forward declaration. */
+static OFF md_skip_to_newline(MD_CTX* ctx, OFF off);
+
+static int
+md_build_line_starts(MD_CTX* ctx)
+{
+    OFF off = 0;
+
+    ctx->n_line_starts = 0;
+    while(TRUE) {
+        if(ctx->n_line_starts >= ctx->alloc_line_starts) {
+            OFF* new_line_starts;
+            int old_alloc = ctx->alloc_line_starts;
+
+            ctx->alloc_line_starts = (ctx->alloc_line_starts > 0
+                    ? ctx->alloc_line_starts + ctx->alloc_line_starts / 2
+                    : 256);
+            new_line_starts = (OFF*) md_realloc(ctx, ctx->line_starts, old_alloc * sizeof(OFF),
+                                                ctx->alloc_line_starts * sizeof(OFF));
+            if(new_line_starts == NULL) {
+                MD_LOG("realloc() failed.");
+                return -1;
+            }
+            ctx->line_starts = new_line_starts;
+        }
+        ctx->line_starts[ctx->n_line_starts++] = off;
+
+        off = md_skip_to_newline(ctx, off);
+        if(off >= ctx->size)
+            break;
+        if(CH(off) == _T('\r')  &&  off+1 < ctx->size  &&  CH(off+1) == _T('\n'))
+            off++;
+        off++;
+    }
+
+    return 0;
+}
+
+/* Index into ctx->line_starts[] of the line off is on. */
+static int
+md_line_index(MD_CTX* ctx, OFF off)
+{
+    int beg = 0;
+    int end = ctx->n_line_starts;
+
+    /* Find the last line starting at or before off. */
+    while(end - beg > 1) {
+        int pivot = beg + (end - beg) / 2;
+        if(ctx->line_starts[pivot] <= off)
+            beg = pivot;
+        else
+            end = pivot;
+    }
+    return beg;
+}
+
+static void
+md_source_range(MD_CTX* ctx, OFF beg, OFF end, MD_SOURCE_RANGE* range)
+{
+    range->beg = ctx->source_base + beg;
+    range->end = ctx->source_base + end;
+    range->beg_line = ctx->source_base_line + md_line_index(ctx, beg) + 1;
+    range->end_line = (end > beg ? ctx->source_base_line + md_line_index(ctx, end-1) + 1 : range->beg_line);
+}
+
+/* Report the source of a block to MD_PARSER::block_source. The block spans
+ * the whole lines from beg to end, where end is the end of the last line (an
+ * empty line ends where it starts). */
+static int
+md_report_block_source(MD_CTX* ctx, MD_BLOCKTYPE type, OFF beg, OFF end,
+                       OFF content_beg, OFF content_end)
+{
+    MD_BLOCK_SOURCE source;
+    int line;
+    int ret = 0;
+
+    if(ctx->parser.block_source == NULL)
+        return 0;
+
+    if(ctx->n_line_starts == 0)
+        MD_CHECK(md_build_line_starts(ctx));
+
+    beg = ctx->line_starts[md_line_index(ctx, beg)];
+    line = md_line_index(ctx, end);
+    if(line + 1 < ctx->n_line_starts) {
+        end = ctx->line_starts[line + 1] - 1;
+        if(end > 0  &&  CH(end) == _T('\n')  &&  CH(end-1) == _T('\r'))
+            end--;
+    } else {
+        end = ctx->size;
+    }
+
+    md_source_range(ctx, beg, end, &source.block);
+    md_source_range(ctx, content_beg, content_end, &source.content);
+
+    ret = ctx->parser.block_source(type, &source, ctx->userdata);
+    if(ret != 0)
+        MD_LOG("Aborted from block_source() callback.");
+
+abort:
+    return ret;
+}
+
+
 /***************************
  ***  Processing Tables  ***
  ***************************/
@@ -4526,7 +4893,8 @@ md_analyze_table_alignment(MD_CTX* ctx, OFF beg, OFF end, MD_ALIGN* align, int n
 }
 
 /* Forward declaration. */
-static int md_process_normal_block_contents(MD_CTX* ctx, const MD_LINE* lines, MD_SIZE n_lines);
+static int md_process_normal_block_contents(MD_CTX* ctx, const MD_LINE* lines, MD_SIZE n_lines, int plain);
+static int md_is_plain_block(MD_CTX* ctx, MD_BLOCKTYPE type, void* detail);
 
 static int
 md_process_table_cell(MD_CTX* ctx, MD_BLOCKTYPE cell_type, MD_ALIGN align, OFF beg, OFF end)
@@ -4544,8 +4912,10 @@ md_process_table_cell(MD_CTX* ctx, MD_BLOCKTYPE cell_type, MD_ALIGN align, OFF b
     line.beg = beg;
     line.end = end;
 
+    MD_CHECK(md_report_block_source(ctx, cell_type, beg, end, beg, end));
     MD_ENTER_BLOCK(cell_type, &det);
-    MD_CHECK(md_process_normal_block_contents(ctx, &line, 1));
+    MD_CHECK(md_process_normal_block_contents(ctx, &line, 1,
+                        md_is_plain_block(ctx, cell_type, &det)));
     MD_LEAVE_BLOCK(cell_type, &det);
 
 abort:
@@ -4557,7 +4927,7 @@ md_process_table_row(MD_CTX* ctx, MD_BLOCKTYPE cell_type, OFF beg, OFF end,
                      const MD_ALIGN* align, int col_count)
 {
     MD_LINE line;
-    OFF* pipe_offs = NULL;
+    OFF* pipe_offs;
     int i, j, k, n;
     int ret = 0;
 
@@ -4568,15 +4938,23 @@ md_process_table_row(MD_CTX* ctx, MD_BLOCKTYPE cell_type, OFF beg, OFF end,
      * form the cell boundary. */
     MD_CHECK(md_analyze_inlines(ctx, &line, 1, TRUE));
 
-    /* We have to remember the cell boundaries in local buffer because
+    /* We have to remember the cell boundaries in a separate buffer because
      * ctx->marks[] shall be reused during cell contents processing. */
     n = ctx->n_table_cell_boundaries + 2;
-    pipe_offs = (OFF*) malloc(n * sizeof(OFF));
-    if(pipe_offs == NULL) {
-        MD_LOG("malloc() failed.");
-        ret = -1;
-        goto abort;
+    if(n > ctx->alloc_table_pipe_offs) {
+        int new_alloc = n + n / 2;
+
+        pipe_offs = (OFF*) md_realloc(ctx, ctx->table_pipe_offs,
+                                ctx->alloc_table_pipe_offs * sizeof(OFF), new_alloc * sizeof(OFF));
+        if(pipe_offs == NULL) {
+            MD_LOG("realloc() failed.");
+            ret = -1;
+            goto abort;
+        }
+        ctx->table_pipe_offs = pipe_offs;
+        ctx->alloc_table_pipe_offs = new_alloc;
     }
+    pipe_offs = ctx->table_pipe_offs;
     j = 0;
     pipe_offs[j++] = beg;
     for(i = ctx->table_cell_boundaries_head; i >= 0; i = ctx->marks[i].next) {
@@ -4586,6 +4964,7 @@ md_process_table_row(MD_CTX* ctx, MD_BLOCKTYPE cell_type, OFF beg, OFF end,
     pipe_offs[j++] = end+1;
 
     /* Process cells. */
+    MD_CHECK(md_report_block_source(ctx, MD_BLOCK_TR, beg, end, beg, end));
     MD_ENTER_BLOCK(MD_BLOCK_TR, NULL);
     k = 0;
     for(i = 0; i < j-1  &&  k < col_count; i++) {
@@ -4595,12 +4974,10 @@ md_process_table_row(MD_CTX* ctx, MD_BLOCKTYPE cell_type, OFF beg, OFF end,
     /* Make sure we call enough table cells even if the current table contains
      * too few of them. */
     while(k < col_count)
-        MD_CHECK(md_process_table_cell(ctx, cell_type, align[k++], 0, 0));
+        MD_CHECK(md_process_table_cell(ctx, cell_type, align[k++], end, end));
     MD_LEAVE_BLOCK(MD_BLOCK_TR, NULL);
 
 abort:
-    free(pipe_offs);
-
     ctx->table_cell_boundaries_head = -1;
     ctx->table_cell_boundaries_tail = -1;
 
@@ -4618,21 +4995,31 @@ md_process_table_block_contents(MD_CTX* ctx, int col_count, const MD_LINE* lines
      * with the underlines. */
     MD_ASSERT(n_lines >= 2);
 
-    align = malloc(col_count * sizeof(MD_ALIGN));
-    if(align == NULL) {
-        MD_LOG("malloc() failed.");
-        ret = -1;
-        goto abort;
+    if(col_count > ctx->alloc_table_align) {
+        align = (MD_ALIGN*) md_realloc(ctx, ctx->table_align,
+                                ctx->alloc_table_align * sizeof(MD_ALIGN), col_count * sizeof(MD_ALIGN));
+        if(align == NULL) {
+            MD_LOG("realloc() failed.");
+            ret = -1;
+            goto abort;
+        }
+        ctx->table_align = align;
+        ctx->alloc_table_align = col_count;
     }
+    align = ctx->table_align;
 
     md_analyze_table_alignment(ctx, lines[1].beg, lines[1].end, align, col_count);
 
+    MD_CHECK(md_report_block_source(ctx, MD_BLOCK_THEAD, lines[0].beg, lines[1].end,
+                        lines[0].beg, lines[0].end));
     MD_ENTER_BLOCK(MD_BLOCK_THEAD, NULL);
     MD_CHECK(md_process_table_row(ctx, MD_BLOCK_TH,
                         lines[0].beg, lines[0].end, align, col_count));
     MD_LEAVE_BLOCK(MD_BLOCK_THEAD, NULL);
 
     if(n_lines > 2) {
+        MD_CHECK(md_report_block_source(ctx, MD_BLOCK_TBODY, lines[2].beg, lines[n_lines-1].end,
+                            lines[2].beg, lines[n_lines-1].end));
         MD_ENTER_BLOCK(MD_BLOCK_TBODY, NULL);
         for(line_index = 2; line_index < n_lines; line_index++) {
             MD_CHECK(md_process_table_row(ctx, MD_BLOCK_TD,
@@ -4642,7 +5029,6 @@ md_process_table_block_contents(MD_CTX* ctx, int col_count, const MD_LINE* lines
     }
 
 abort:
-    free(align);
     return ret;
 }
 
@@ -4656,6 +5042,7 @@ abort:
 #define MD_BLOCK_CONTAINER          (MD_BLOCK_CONTAINER_OPENER | MD_BLOCK_CONTAINER_CLOSER)
 #define MD_BLOCK_LOOSE_LIST         0x04
 #define MD_BLOCK_SETEXT_HEADER      0x08
+#define MD_BLOCK_CLOSING_FENCE      0x10    /* Last line is the closing code fence. */
 
 struct MD_BLOCK_tag {
     MD_BLOCKTYPE type  :  8;
@@ -4687,19 +5074,37 @@ struct MD_CONTAINER_tag {
 };
 
 
+/* Whether the application wants the contents of the block as plain text,
+ * see MD_PARSER::plain_text. */
+static int
+md_is_plain_block(MD_CTX* ctx, MD_BLOCKTYPE type, void* detail)
+{
+    if(ctx->parser.plain_text == NULL)
+        return FALSE;
+    return ctx->parser.plain_text(type, detail, ctx->userdata) != 0;
+}
+
 static int
-md_process_normal_block_contents(MD_CTX* ctx, const MD_LINE* lines, MD_SIZE n_lines)
+md_process_normal_block_contents(MD_CTX* ctx, const MD_LINE* lines, MD_SIZE n_lines, int plain)
 {
+    MD_MARK* mark;
     int i;
     int ret;
 
-    MD_CHECK(md_analyze_inlines(ctx, lines, n_lines, FALSE));
+    if(plain) {
+        /* Only the dummy mark md_process_inlines() expects at the end, so it
+         * outputs the lines as they are, with the line breaks between. */
+        ctx->n_marks = 0;
+        ADD_MARK(127, ctx->size, ctx->size, MD_MARK_RESOLVED);
+    } else {
+        MD_CHECK(md_analyze_inlines(ctx, lines, n_lines, FALSE));
+    }
     MD_CHECK(md_process_inlines(ctx, lines, n_lines));
 
 abort:
     /* Free any temporary memory blocks stored within some dummy marks. */
     for(i = ctx->ptr_stack.top; i >= 0; i = ctx->marks[i].next)
-        free(md_mark_get_ptr(ctx, i));
+        md_free(ctx, md_mark_get_ptr(ctx, i));
     ctx->ptr_stack.top = -1;
 
     return ret;
@@ -4739,14 +5144,20 @@ abort:
     return ret;
 }
 
-static int
-md_process_code_block_contents(MD_CTX* ctx, int is_fenced, const MD_VERBATIMLINE* lines, MD_SIZE n_lines)
+/* The lines of a code block which hold code. */
+static const MD_VERBATIMLINE*
+md_code_block_lines(const MD_BLOCK* block, MD_SIZE* p_n_lines)
 {
-    if(is_fenced) {
-        /* Skip the first line in case of fenced code: It is the fence.
-         * (Only the starting fence is present due to logic in md_analyze_line().) */
+    const MD_VERBATIMLINE* lines = (const MD_VERBATIMLINE*)(block + 1);
+    MD_SIZE n_lines = block->n_lines;
+
+    if(block->data != 0) {
+        /* Skip the first line in case of fenced code: It is the fence. And
+         * the last one if it is the closing fence. */
         lines++;
         n_lines--;
+        if(block->flags & MD_BLOCK_CLOSING_FENCE)
+            n_lines--;
     } else {
         /* Ignore blank lines at start/end of indented code block. */
         while(n_lines > 0  &&  lines[0].beg == lines[0].end) {
@@ -4758,12 +5169,65 @@ md_process_code_block_contents(MD_CTX* ctx, int is_fenced, const MD_VERBATIMLINE
         }
     }
 
+    *p_n_lines = n_lines;
+    return lines;
+}
+
+static int
+md_process_code_block_contents(MD_CTX* ctx, const MD_BLOCK* block)
+{
+    MD_SIZE n_lines;
+    const MD_VERBATIMLINE* lines = md_code_block_lines(block, &n_lines);
+
     if(n_lines == 0)
         return 0;
 
     return md_process_verbatim_block_contents(ctx, MD_TEXT_CODE, lines, n_lines);
 }
 
+/* First and last offset of the lines of a leaf block. */
+static void
+md_leaf_block_extent(MD_CTX* ctx, const MD_BLOCK* block, OFF* p_beg, OFF* p_end)
+{
+    MD_UNUSED(ctx);
+    MD_ASSERT(block->n_lines > 0);
+
+    if(block->type == MD_BLOCK_CODE  ||  block->type == MD_BLOCK_HTML) {
+        const MD_VERBATIMLINE* lines = (const MD_VERBATIMLINE*)(block + 1);
+        *p_beg = lines[0].beg;
+        *p_end = lines[block->n_lines-1].end;
+    } else {
+        const MD_LINE* lines = (const MD_LINE*)(block + 1);
+        *p_beg = lines[0].beg;
+        *p_end = lines[block->n_lines-1].end;
+    }
+}
+
+static int
+md_report_leaf_block_source(MD_CTX* ctx, const MD_BLOCK* block)
+{
+    OFF beg, end;
+    OFF content_beg, content_end;
+
+    md_leaf_block_extent(ctx, block, &beg, &end);
+    content_beg = beg;
+    content_end = end;
+
+    if(block->type == MD_BLOCK_CODE) {
+        MD_SIZE n_lines;
+        const MD_VERBATIMLINE* lines = md_code_block_lines(block, &n_lines);
+
+        if(n_lines > 0) {
+            content_beg = lines[0].beg;
+            content_end = lines[n_lines-1].end;
+        } else {
+            content_beg = end;
+        }
+    }
+
+    return md_report_block_source(ctx, block->type, beg, end, content_beg, content_end);
+}
+
 static int
 md_setup_fenced_code_detail(MD_CTX* ctx, const MD_BLOCK* block, MD_BLOCK_CODE_DETAIL* det,
                             MD_ATTRIBUTE_BUILD* info_build, MD_ATTRIBUTE_BUILD* lang_build)
@@ -4847,8 +5311,11 @@ md_process_leaf_block(MD_CTX* ctx, const MD_BLOCK* block)
             break;
     }
 
-    if(!is_in_tight_list  ||  block->type != MD_BLOCK_P)
+    if(!is_in_tight_list  ||  block->type != MD_BLOCK_P) {
+        if(ctx->parser.block_source != NULL)
+            MD_CHECK(md_report_leaf_block_source(ctx, block));
         MD_ENTER_BLOCK(block->type, (void*) &det);
+    }
 
     /* Process the block contents accordingly to is type. */
     switch(block->type) {
@@ -4857,8 +5324,7 @@ md_process_leaf_block(MD_CTX* ctx, const MD_BLOCK* block)
             break;
 
         case MD_BLOCK_CODE:
-            MD_CHECK(md_process_code_block_contents(ctx, (block->data != 0),
-                            (const MD_VERBATIMLINE*)(block + 1), block->n_lines));
+            MD_CHECK(md_process_code_block_contents(ctx, block));
             break;
 
         case MD_BLOCK_HTML:
@@ -4873,7 +5339,8 @@ md_process_leaf_block(MD_CTX* ctx, const MD_BLOCK* block)
 
         default:
             MD_CHECK(md_process_normal_block_contents(ctx,
-                            (const MD_LINE*)(block + 1), block->n_lines));
+                            (const MD_LINE*)(block + 1), block->n_lines,
+                            md_is_plain_block(ctx, block->type, (void*) &det)));
             break;
     }
 
@@ -4888,10 +5355,66 @@ abort:
     return ret;
 }
 
+/* Find where every container block recorded by md_push_container_source()
+ * ends: at the last line of its last leaf block, or on its own line if it
+ * has none. Its contents start with its first leaf block. */
+static void
+md_analyze_container_sources(MD_CTX* ctx)
+{
+    int byte_off = 0;
+    int n_opened = 0;
+    int current = -1;   /* Innermost open container. */
+
+    while(byte_off < ctx->n_block_bytes) {
+        const MD_BLOCK* block = (const MD_BLOCK*)((char*)ctx->block_bytes + byte_off);
+
+        if(block->flags & MD_BLOCK_CONTAINER) {
+            if(block->flags & MD_BLOCK_CONTAINER_CLOSER) {
+                MD_CONTAINER_SOURCE* src = &ctx->container_sources[current];
+
+                /* Empty container. */
+                if(src->content_beg == (OFF)(-1))
+                    src->content_beg = src->end;
+                current = src->parent;
+                if(current >= 0  &&  ctx->container_sources[current].end < src->end)
+                    ctx->container_sources[current].end = src->end;
+            }
+
+            if(block->flags & MD_BLOCK_CONTAINER_OPENER) {
+                MD_ASSERT(n_opened < ctx->n_container_sources);
+                ctx->container_sources[n_opened].parent = current;
+                current = n_opened++;
+            }
+        } else {
+            OFF beg, end;
+            int i;
+
+            md_leaf_block_extent(ctx, block, &beg, &end);
+            if(current >= 0)
+                ctx->container_sources[current].end = end;
+
+            /* The containers which have not seen a leaf block yet start
+             * their contents here. They are the innermost ones, so stop at
+             * the first which has. */
+            for(i = current; i >= 0  &&  ctx->container_sources[i].content_beg == (OFF)(-1);
+                        i = ctx->container_sources[i].parent)
+                ctx->container_sources[i].content_beg = beg;
+
+            if(block->type == MD_BLOCK_CODE || block->type == MD_BLOCK_HTML)
+                byte_off += block->n_lines * sizeof(MD_VERBATIMLINE);
+            else
+                byte_off += block->n_lines * sizeof(MD_LINE);
+        }
+
+        byte_off += sizeof(MD_BLOCK);
+    }
+}
+
 static int
 md_process_all_blocks(MD_CTX* ctx)
 {
     int byte_off = 0;
+    int container_index = 0;
     int ret = 0;
 
     /* ctx->containers now is not needed for detection of lists and list items
@@ -4900,6 +5423,9 @@ md_process_all_blocks(MD_CTX* ctx)
      * level of lists. */
     ctx->n_containers = 0;
 
+    if(ctx->parser.block_source != NULL)
+        md_analyze_container_sources(ctx);
+
     while(byte_off < ctx->n_block_bytes) {
         MD_BLOCK* block = (MD_BLOCK*)((char*)ctx->block_bytes + byte_off);
         union {
@@ -4923,7 +5449,7 @@ md_process_all_blocks(MD_CTX* ctx)
             case MD_BLOCK_LI:
                 det.li.is_task = (block->data != 0);
                 det.li.task_mark = (CHAR) block->data;
-                det.li.task_mark_offset = (OFF) block->n_lines;
+                det.li.task_mark_offset = ctx->source_base + (OFF) block->n_lines;
                 break;
 
             default:
@@ -4940,6 +5466,11 @@ md_process_all_blocks(MD_CTX* ctx)
             }
 
             if(block->flags & MD_BLOCK_CONTAINER_OPENER) {
+                if(ctx->parser.block_source != NULL) {
+                    const MD_CONTAINER_SOURCE* src = &ctx->container_sources[container_index++];
+                    MD_CHECK(md_report_block_source(ctx, block->type, src->beg, src->end,
+                                                  src->content_beg, src->end));
+                }
                 MD_ENTER_BLOCK(block->type, &det);
 
                 if(block->type == MD_BLOCK_UL || block->type == MD_BLOCK_OL) {
@@ -4983,11 +5514,12 @@ md_push_block_bytes(MD_CTX* ctx, int n_bytes)
 
     if(ctx->n_block_bytes + n_bytes > ctx->alloc_block_bytes) {
         void* new_block_bytes;
+        int old_alloc = ctx->alloc_block_bytes;
 
         ctx->alloc_block_bytes = (ctx->alloc_block_bytes > 0
                 ? ctx->alloc_block_bytes + ctx->alloc_block_bytes / 2
                 : 512);
-        new_block_bytes = realloc(ctx->block_bytes, ctx->alloc_block_bytes);
+        new_block_bytes = md_realloc(ctx, ctx->block_bytes, old_alloc, ctx->alloc_block_bytes);
         if(new_block_bytes == NULL) {
             MD_LOG("realloc() failed.");
             return NULL;
@@ -5204,6 +5736,42 @@ abort:
     return ret;
 }
 
+/* Remember the line a container block has been opened on, in the order of
+ * the openers in ctx->block_bytes. md_analyze_container_sources() finds
+ * where it ends. */
+static int
+md_push_container_source(MD_CTX* ctx, OFF beg)
+{
+    MD_CONTAINER_SOURCE* src;
+
+    if(ctx->parser.block_source == NULL)
+        return 0;
+
+    if(ctx->n_container_sources >= ctx->alloc_container_sources) {
+        MD_CONTAINER_SOURCE* new_sources;
+        int old_alloc = ctx->alloc_container_sources;
+
+        ctx->alloc_container_sources = (ctx->alloc_container_sources > 0
+                ? ctx->alloc_container_sources + ctx->alloc_container_sources / 2
+                : 16);
+        new_sources = (MD_CONTAINER_SOURCE*) md_realloc(ctx, ctx->container_sources,
+                    old_alloc * sizeof(MD_CONTAINER_SOURCE),
+                    ctx->alloc_container_sources * sizeof(MD_CONTAINER_SOURCE));
+        if(new_sources == NULL) {
+            MD_LOG("realloc() failed.");
+            return -1;
+        }
+        ctx->container_sources = new_sources;
+    }
+
+    src = &ctx->container_sources[ctx->n_container_sources++];
+    src->beg = beg;
+    src->end = beg;
+    src->content_beg = (OFF)(-1);
+    src->parent = -1;
+    return 0;
+}
+
 
 
 /***********************
@@ -5631,11 +6199,13 @@ md_push_container(MD_CTX* ctx, const MD_CONTAINER* container)
 {
     if(ctx->n_containers >= ctx->alloc_containers) {
         MD_CONTAINER* new_containers;
+        int old_alloc = ctx->alloc_containers;
 
         ctx->alloc_containers = (ctx->alloc_containers > 0
                 ? ctx->alloc_containers + ctx->alloc_containers / 2
                 : 16);
-        new_containers = realloc(ctx->containers, ctx->alloc_containers * sizeof(MD_CONTAINER));
+        new_containers = md_realloc(ctx, ctx->containers, old_alloc * sizeof(MD_CONTAINER),
+                                    ctx->alloc_containers * sizeof(MD_CONTAINER));
         if(new_containers == NULL) {
             MD_LOG("realloc() failed.");
             return -1;
@@ -5649,7 +6219,7 @@ md_push_container(MD_CTX* ctx, const MD_CONTAINER* container)
 }
 
 static int
-md_enter_child_containers(MD_CTX* ctx, int n_children)
+md_enter_child_containers(MD_CTX* ctx, int n_children, OFF beg)
 {
     int i;
     int ret = 0;
@@ -5679,10 +6249,13 @@ md_enter_child_containers(MD_CTX* ctx, int n_children)
                                 c->task_mark_off,
                                 (c->is_task ? CH(c->task_mark_off) : 0),
                                 MD_BLOCK_CONTAINER_OPENER));
+                MD_CHECK(md_push_container_source(ctx, beg));
+                MD_CHECK(md_push_container_source(ctx, beg));
                 break;
 
             case _T('>'):
                 MD_CHECK(md_push_container_bytes(ctx, MD_BLOCK_QUOTE, 0, 0, MD_BLOCK_CONTAINER_OPENER));
+                MD_CHECK(md_push_container_source(ctx, beg));
                 break;
 
             default:
@@ -5814,10 +6387,205 @@ md_line_indentation(MD_CTX* ctx, unsigned total_indent, OFF beg, OFF* p_end)
     return indent - total_indent;
 }
 
-static const MD_LINE_ANALYSIS md_dummy_blank_line = { MD_LINE_BLANK, 0, 0, 0, 0, 0 };
-
-/* Analyze type of the line and find some its properties. This serves as a
- * main input for determining type and boundaries of a block. */
+/* Find the next line break at or after off, or the end of the document.
+ *
+ * Note this is quite a bottleneck of the parsing as we here iterate almost
+ * over compete document.
+ */
+static OFF
+md_skip_to_newline(MD_CTX* ctx, OFF off)
+{
+#if defined __linux__ && !defined MD4C_USE_UTF16
+    /* Recent glibc versions have superbly optimized strcspn(), even using
+     * vectorization if available. */
+    if(ctx->doc_ends_with_newline  &&  off < ctx->size) {
+        while(TRUE) {
+            off += (OFF) strcspn(STR(off), "\r\n");
+
+            /* strcspn() can stop on zero terminator; but that can appear
+             * anywhere in the Markfown input... */
+            if(CH(off) == _T('\0'))
+                off++;
+            else
+                break;
+        }
+    } else
+#endif
+    {
+        /* Optimization: Use some loop unrolling. */
+        while(off + 3 < ctx->size  &&  !ISNEWLINE(off+0)  &&  !ISNEWLINE(off+1)
+                                   &&  !ISNEWLINE(off+2)  &&  !ISNEWLINE(off+3))
+            off += 4;
+        while(off < ctx->size  &&  !ISNEWLINE(off))
+            off++;
+    }
+
+    return off;
+}
+
+#ifdef MD4C_SIMD
+
+/* Line break, blank and tab characters among the 64 ones at `block`, one bit
+ * for each. */
+typedef struct MD_LINE_BITS_tag MD_LINE_BITS;
+struct MD_LINE_BITS_tag {
+    OFF block;
+    uint64_t newline;
+    uint64_t blank;
+    uint64_t tab;
+};
+
+__attribute__((target("sse2")))
+static void
+md_line_bits_sse2(const CHAR* p, MD_LINE_BITS* bits)
+{
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    int i;
+
+    bits->newline = 0;
+    bits->blank = 0;
+    bits->tab = 0;
+    for(i = 0; i < 64; i += 16) {
+        __m128i data = _mm_loadu_si128((const __m128i*) (p + i));
+        __m128i is_tab = _mm_cmpeq_epi8(data, tab);
+
+        bits->newline |= (uint64_t) (unsigned) _mm_movemask_epi8(
+                _mm_or_si128(_mm_cmpeq_epi8(data, cr), _mm_cmpeq_epi8(data, lf))) << i;
+        bits->blank |= (uint64_t) (unsigned) _mm_movemask_epi8(
+                _mm_or_si128(_mm_cmpeq_epi8(data, space), is_tab)) << i;
+        bits->tab |= (uint64_t) (unsigned) _mm_movemask_epi8(is_tab) << i;
+    }
+}
+
+__attribute__((target("avx2")))
+static void
+md_line_bits_avx2(const CHAR* p, MD_LINE_BITS* bits)
+{
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    int i;
+
+    bits->newline = 0;
+    bits->blank = 0;
+    bits->tab = 0;
+    for(i = 0; i < 64; i += 32) {
+        __m256i data = _mm256_loadu_si256((const __m256i*) (p + i));
+        __m256i is_tab = _mm256_cmpeq_epi8(data, tab);
+
+        bits->newline |= (uint64_t) (unsigned) _mm256_movemask_epi8(
+                _mm256_or_si256(_mm256_cmpeq_epi8(data, cr), _mm256_cmpeq_epi8(data, lf))) << i;
+        bits->blank |= (uint64_t) (unsigned) _mm256_movemask_epi8(
+                _mm256_or_si256(_mm256_cmpeq_epi8(data, space), is_tab)) << i;
+        bits->tab |= (uint64_t) (unsigned) _mm256_movemask_epi8(is_tab) << i;
+    }
+}
+
+/* Make bits cover off. Fails near the end of the document. */
+static int
+md_line_bits_load(MD_CTX* ctx, MD_LINE_BITS* bits, OFF off)
+{
+    if(off - bits->block < 64  &&  bits->block <= off)
+        return TRUE;
+    if(off + 64 > ctx->size)
+        return FALSE;
+
+    bits->block = off;
+    if(ctx->simd == MD_SIMD_AVX2)
+        md_line_bits_avx2(STR(off), bits);
+    else
+        md_line_bits_sse2(STR(off), bits);
+    return TRUE;
+}
+
+/* Fill brk for the line at brk->beg from the bit masks. Fails when it would
+ * need characters past the end of the document or when the indentation does
+ * not end within a block. */
+static int
+md_scan_line_bits(MD_CTX* ctx, MD_LINE_BITS* bits, MD_LINE_BREAK* brk)
+{
+    OFF off = brk->beg;
+    unsigned shift;
+    uint64_t rest;
+
+    if(!md_line_bits_load(ctx, bits, off))
+        return FALSE;
+
+    shift = (unsigned) (off - bits->block);
+    rest = ~bits->blank >> shift;
+    if(rest == 0)
+        return FALSE;
+
+    off += (OFF) __builtin_ctzll(rest);
+    if(((bits->tab >> shift) & ((((uint64_t) 1) << (off - brk->beg)) - 1)) != 0)
+        brk->indent = md_line_indentation(ctx, 0, brk->beg, &off);
+    else
+        brk->indent = (unsigned) (off - brk->beg);
+    brk->indent_end = off;
+
+    while(TRUE) {
+        if(!md_line_bits_load(ctx, bits, off))
+            return FALSE;
+
+        rest = bits->newline >> (off - bits->block);
+        if(rest != 0) {
+            brk->end = off + (OFF) __builtin_ctzll(rest);
+            return TRUE;
+        }
+        off = bits->block + 64;
+    }
+}
+
+#endif  /* MD4C_SIMD */
+
+/* Find where the lines starting at beg end and how they are indented, for a
+ * batch of lines at once. With SIMD, the line breaks and blanks of each 64
+ * characters are located at once as bit masks, so a run of short lines
+ * (typically a code block) costs a single vector pass over its bytes.
+ */
+static void
+md_scan_lines(MD_CTX* ctx, OFF beg)
+{
+    OFF off = beg;
+    int n = 0;
+#ifdef MD4C_SIMD
+    MD_LINE_BITS bits;
+
+    bits.block = (OFF) -64;     /* Covers nothing. */
+#endif
+
+    while(n < MD_LINE_BREAK_BATCH  &&  off < ctx->size) {
+        MD_LINE_BREAK* brk = &ctx->line_breaks[n++];
+
+        brk->beg = off;
+#ifdef MD4C_SIMD
+        if(ctx->simd == MD_SIMD_SCALAR  ||  !md_scan_line_bits(ctx, &bits, brk))
+#endif
+        {
+            brk->indent = md_line_indentation(ctx, 0, off, &brk->indent_end);
+            brk->end = md_skip_to_newline(ctx, brk->indent_end);
+        }
+        off = brk->end;
+
+        /* Eat also the new line. */
+        if(off < ctx->size  &&  CH(off) == _T('\r'))
+            off++;
+        if(off < ctx->size  &&  CH(off) == _T('\n'))
+            off++;
+    }
+
+    ctx->n_line_breaks = n;
+    ctx->line_break_index = 0;
+}
+
+static const MD_LINE_ANALYSIS md_dummy_blank_line = { MD_LINE_BLANK, 0, 0, 0, 0, 0, 0 };
+
+/* Analyze type of the line and find some its properties. This serves as a
+ * main input for determining type and boundaries of a block. */
 static int
 md_analyze_line(MD_CTX* ctx, OFF beg, OFF* p_end,
                 const MD_LINE_ANALYSIS* pivot_line, MD_LINE_ANALYSIS* line)
@@ -5828,14 +6596,21 @@ md_analyze_line(MD_CTX* ctx, OFF beg, OFF* p_end,
     int n_children = 0;
     MD_CONTAINER container = { 0 };
     int prev_line_has_list_loosening_effect = ctx->last_line_has_list_loosening_effect;
-    OFF off = beg;
+    const MD_LINE_BREAK* brk;
+    OFF off;
     OFF hr_killer = 0;
     int ret = 0;
 
-    line->indent = md_line_indentation(ctx, total_indent, off, &off);
+    if(ctx->line_break_index >= ctx->n_line_breaks  ||  ctx->line_breaks[ctx->line_break_index].beg != beg)
+        md_scan_lines(ctx, beg);
+    brk = &ctx->line_breaks[ctx->line_break_index++];
+
+    line->indent = brk->indent;
+    off = brk->indent_end;
     total_indent += line->indent;
     line->beg = off;
     line->enforce_new_block = FALSE;
+    line->is_closing_fence = FALSE;
 
     /* Given the indentation and block quote marks '>', determine how many of
      * the current containers are our parents. */
@@ -5886,6 +6661,7 @@ md_analyze_line(MD_CTX* ctx, OFF beg, OFF* p_end,
             if(line->indent < ctx->code_indent_offset) {
                 if(md_is_closing_code_fence(ctx, CH(pivot_line->beg), off, &off)) {
                     line->type = MD_LINE_BLANK;
+                    line->is_closing_fence = TRUE;
                     ctx->last_line_has_list_loosening_effect = FALSE;
                     break;
                 }
@@ -6214,35 +6990,12 @@ md_analyze_line(MD_CTX* ctx, OFF beg, OFF* p_end,
         break;
     }
 
-    /* Scan for end of the line.
-     *
-     * Note this is quite a bottleneck of the parsing as we here iterate almost
-     * over compete document.
-     */
-#if defined __linux__ && !defined MD4C_USE_UTF16
-    /* Recent glibc versions have superbly optimized strcspn(), even using
-     * vectorization if available. */
-    if(ctx->doc_ends_with_newline  &&  off < ctx->size) {
-        while(TRUE) {
-            off += (OFF) strcspn(STR(off), "\r\n");
-
-            /* strcspn() can stop on zero terminator; but that can appear
-             * anywhere in the Markfown input... */
-            if(CH(off) == _T('\0'))
-                off++;
-            else
-                break;
-        }
-    } else
-#endif
-    {
-        /* Optimization: Use some loop unrolling. */
-        while(off + 3 < ctx->size  &&  !ISNEWLINE(off+0)  &&  !ISNEWLINE(off+1)
-                                   &&  !ISNEWLINE(off+2)  &&  !ISNEWLINE(off+3))
-            off += 4;
-        while(off < ctx->size  &&  !ISNEWLINE(off))
-            off++;
-    }
+    /* Scan for end of the line. md_scan_lines() has usually found it
+     * already. */
+    if(off <= brk->end)
+        off = brk->end;
+    else
+        off = md_skip_to_newline(ctx, off);
 
     /* Set end of the line. */
     line->end = off;
@@ -6296,12 +7049,13 @@ md_analyze_line(MD_CTX* ctx, OFF beg, OFF* p_end,
                     container.task_mark_off,
                     (container.is_task ? CH(container.task_mark_off) : 0),
                     MD_BLOCK_CONTAINER_OPENER));
+        MD_CHECK(md_push_container_source(ctx, beg));
         ctx->containers[n_parents].is_task = container.is_task;
         ctx->containers[n_parents].task_mark_off = container.task_mark_off;
     }
 
     if(n_children > 0)
-        MD_CHECK(md_enter_child_containers(ctx, n_children));
+        MD_CHECK(md_enter_child_containers(ctx, n_children, beg));
 
 abort:
     return ret;
@@ -6315,6 +7069,15 @@ md_process_line(MD_CTX* ctx, const MD_LINE_ANALYSIS** p_pivot_line, MD_LINE_ANAL
 
     /* Blank line ends current leaf block. */
     if(line->type == MD_LINE_BLANK) {
+        /* Keep the closing fence as the last line of the code block, so its
+         * source range covers it. (Leaving a container may have ended the
+         * block already.) */
+        if(line->is_closing_fence  &&  ctx->current_block != NULL  &&
+           ctx->current_block->type == MD_BLOCK_CODE)
+        {
+            MD_CHECK(md_add_line_into_current_block(ctx, line));
+            ctx->current_block->flags |= MD_BLOCK_CLOSING_FENCE;
+        }
         MD_CHECK(md_end_current_block(ctx));
         *p_pivot_line = &md_dummy_blank_line;
         return 0;
@@ -6392,6 +7155,7 @@ md_process_doc(MD_CTX *ctx)
     OFF off = 0;
     int ret = 0;
 
+    MD_CHECK(md_report_block_source(ctx, MD_BLOCK_DOC, 0, ctx->size, 0, ctx->size));
     MD_ENTER_BLOCK(MD_BLOCK_DOC, NULL);
 
     while(off < ctx->size) {
@@ -6440,53 +7204,479 @@ abort:
 }
 
 
+/*******************************
+ ***  Processing Fed Chunks  ***
+ *******************************/
+
+/* md_parser_feed() runs the same line analysis as md_process_doc(), but only
+ * over the complete lines received so far, keeping the line state in
+ * MD_FEED between the calls. Whenever a line leaves no container and no
+ * leaf block open, nothing the following lines do can change the blocks
+ * collected so far: they are processed and their text is dropped. */
+
+/* Refer the link reference definitions which point into the fed text to
+ * where it has moved. */
+static void
+md_feed_rebase_ref_defs(MD_CTX* ctx, const CHAR* old_text, SZ old_size)
+{
+    int i;
+
+    for(i = 0; i < ctx->n_ref_defs; i++) {
+        MD_REF_DEF* def = &ctx->ref_defs[i];
+
+        if(!def->label_needs_free  &&  def->label >= old_text  &&  def->label <= old_text + old_size)
+            def->label = (CHAR*) ctx->text + (def->label - old_text);
+        if(!def->title_needs_free  &&  def->title != NULL  &&
+           def->title >= old_text  &&  def->title <= old_text + old_size)
+            def->title = (CHAR*) ctx->text + (def->title - old_text);
+    }
+}
+
+/* Append a chunk to the fed text, dropping what has been emitted before. */
+static int
+md_feed_append(MD_CTX* ctx, const CHAR* text, SZ size)
+{
+    MD_FEED* feed = ctx->feed;
+    const CHAR* old_text = ctx->text;
+    SZ old_size = feed->size - feed->text_off;
+
+    if(feed->text_off > 0) {
+        memmove(feed->buffer, feed->buffer + feed->text_off, old_size * sizeof(CHAR));
+        feed->size = old_size;
+        feed->text_off = 0;
+    }
+
+    if(size > feed->alloc_buffer - feed->size) {
+        CHAR* new_buffer;
+        SZ old_alloc = feed->alloc_buffer;
+        SZ new_alloc;
+
+        if(size > SZ_MAX - feed->size) {
+            MD_LOG("Document too large.");
+            return -1;
+        }
+        new_alloc = feed->alloc_buffer + feed->alloc_buffer / 2;
+        if(new_alloc < feed->size + size)
+            new_alloc = feed->size + size;
+        if(new_alloc < 4096)
+            new_alloc = 4096;
+
+        new_buffer = (CHAR*) md_realloc(ctx, feed->buffer, old_alloc * sizeof(CHAR),
+                                        new_alloc * sizeof(CHAR));
+        if(new_buffer == NULL) {
+            MD_LOG("realloc() failed.");
+            return -1;
+        }
+        feed->buffer = new_buffer;
+        feed->alloc_buffer = new_alloc;
+    }
+
+    if(size > 0)
+        memcpy(feed->buffer + feed->size, text, size * sizeof(CHAR));
+    feed->size += size;
+
+    ctx->text = feed->buffer;
+    if(ctx->text != old_text)
+        md_feed_rebase_ref_defs(ctx, old_text, old_size);
+    return 0;
+}
+
+/* Process the blocks collected up to feed->off, where no block is open, and
+ * move ctx->text past them. */
+static int
+md_feed_flush(MD_CTX* ctx)
+{
+    MD_FEED* feed = ctx->feed;
+    OFF off = feed->off;
+    SZ size = ctx->size;
+    OFF i;
+    int j;
+    int ret = 0;
+
+    MD_ASSERT(ctx->current_block == NULL  &&  ctx->n_containers == 0);
+
+    /* The blocks see the document end at off. */
+    ctx->size = off;
+    ctx->n_line_starts = 0;
+    ctx->max_ref_def_output = MIN(MIN(16 * (uint64_t)off, (uint64_t)(1024 * 1024)), (uint64_t)SZ_MAX);
+
+    MD_CHECK(md_build_ref_def_hashtable(ctx));
+    MD_CHECK(md_process_all_blocks(ctx));
+
+    md_free_ref_def_hashtable(ctx);
+    ctx->ref_def_hashtable = NULL;
+    ctx->ref_def_hashtable_size = 0;
+    md_free_ref_defs(ctx);
+    ctx->n_block_bytes = 0;
+    ctx->n_container_sources = 0;
+    ctx->n_line_starts = 0;
+
+    if(ctx->parser.block_source != NULL) {
+        for(i = 0; i < off; i++) {
+            if(CH(i) == _T('\n')  ||  (CH(i) == _T('\r')  &&  (i+1 >= off  ||  CH(i+1) != _T('\n'))))
+                ctx->source_base_line++;
+        }
+    }
+    ctx->source_base += off;
+
+    /* Everything which refers to the text by offsets starts anew. The lines
+     * scanned ahead are kept: a flush usually happens every few lines. */
+    ctx->text += off;
+    ctx->size = size - off;
+    feed->text_off += off;
+    feed->off = 0;
+    for(j = ctx->line_break_index; j < ctx->n_line_breaks; j++) {
+        ctx->line_breaks[j].beg -= off;
+        ctx->line_breaks[j].end -= off;
+        ctx->line_breaks[j].indent_end -= off;
+    }
+    ctx->html_comment_horizon = 0;
+    ctx->html_proc_instr_horizon = 0;
+    ctx->html_decl_horizon = 0;
+    ctx->html_cdata_horizon = 0;
+
+abort:
+    return ret;
+}
+
+/* Analyze the lines from feed->off up to ctx->size, which ends with a line
+ * break unless the input is complete. */
+static int
+md_feed_lines(MD_CTX* ctx)
+{
+    MD_FEED* feed = ctx->feed;
+    int ret = 0;
+
+    /* The lines scanned ahead may have ended at the previous ctx->size. */
+    ctx->n_line_breaks = 0;
+    ctx->line_break_index = 0;
+
+    while(feed->off < ctx->size) {
+        MD_LINE_ANALYSIS* line = (feed->pivot_line == &feed->line_buf[0]
+                    ? &feed->line_buf[1] : &feed->line_buf[0]);
+
+        MD_CHECK(md_analyze_line(ctx, feed->off, &feed->off, feed->pivot_line, line));
+        MD_CHECK(md_process_line(ctx, &feed->pivot_line, line));
+
+        if(ctx->current_block == NULL  &&  ctx->n_containers == 0  &&
+           feed->pivot_line == &md_dummy_blank_line)
+            MD_CHECK(md_feed_flush(ctx));
+    }
+
+abort:
+    return ret;
+}
+
+/* Offset after the last line break of the fed text which surely is one: a
+ * trailing '\r' may be the first half of "\r\n". Only the bytes from
+ * ctx->size on are new. */
+static OFF
+md_feed_complete_lines(MD_CTX* ctx)
+{
+    MD_FEED* feed = ctx->feed;
+    OFF size = feed->size - feed->text_off;
+    OFF off = size;
+
+    while(off > ctx->size) {
+        if(CH(off-1) == _T('\n')  ||  (CH(off-1) == _T('\r')  &&  off < size))
+            return off;
+        off--;
+    }
+    return ctx->size;
+}
+
+
 /********************
  ***  Public API  ***
  ********************/
 
+/* Reset all mark stacks and lists. */
+static void
+md_init_stacks(MD_CTX* ctx)
+{
+    int i;
+
+    for(i = 0; i < (int) SIZEOF_ARRAY(ctx->opener_stacks); i++)
+        ctx->opener_stacks[i].top = -1;
+    ctx->ptr_stack.top = -1;
+    ctx->unresolved_link_head = -1;
+    ctx->unresolved_link_tail = -1;
+    ctx->table_cell_boundaries_head = -1;
+    ctx->table_cell_boundaries_tail = -1;
+}
+
+/* Size of the MD_PARSER structure in its abi_version, or zero if the version
+ * is not supported. */
+static size_t
+md_parser_size(const MD_PARSER* parser)
+{
+    switch(parser->abi_version) {
+        case MD_PARSER_ABI_BASE:    return offsetof(MD_PARSER, mem_alloc);
+        case MD_PARSER_ABI_ALLOC:   return offsetof(MD_PARSER, plain_text);
+        case MD_PARSER_ABI_PLAIN:   return offsetof(MD_PARSER, block_source);
+        case MD_PARSER_ABI_SOURCE:  return sizeof(MD_PARSER);
+        default:                    return 0;
+    }
+}
+
+/* Setup ctx for parser. */
+static void
+md_init_ctx(MD_CTX* ctx, const MD_PARSER* parser)
+{
+    memset(ctx, 0, sizeof(MD_CTX));
+    /* Copy only the members the application knows about, the rest stays zero. */
+    memcpy(&ctx->parser, parser, md_parser_size(parser));
+#ifdef MD4C_SIMD
+    ctx->simd = md_simd_level();
+#endif
+    ctx->code_indent_offset = (ctx->parser.flags & MD_FLAG_NOINDENTEDCODEBLOCKS) ? (OFF)(-1) : 4;
+    md_build_mark_char_map(ctx);
+    md_init_stacks(ctx);
+}
+
+/* Reset all the per-document state of ctx after a parse. The parser setup
+ * and the growing buffers survive, so a reused context parses without
+ * reallocating them. */
+static void
+md_reset_ctx(MD_CTX* ctx)
+{
+    MD_CTX keep;
+
+    memcpy(&keep, ctx, sizeof(MD_CTX));
+    memset(ctx, 0, sizeof(MD_CTX));
+
+    memcpy(&ctx->parser, &keep.parser, sizeof(MD_PARSER));
+#ifdef MD4C_SIMD
+    ctx->simd = keep.simd;
+    memcpy(ctx->mark_nibbles, keep.mark_nibbles, sizeof(ctx->mark_nibbles));
+#endif
+    memcpy(ctx->mark_char_map, keep.mark_char_map, sizeof(ctx->mark_char_map));
+    ctx->code_indent_offset = keep.code_indent_offset;
+
+    ctx->buffer = keep.buffer;
+    ctx->alloc_buffer = keep.alloc_buffer;
+    ctx->ref_defs = keep.ref_defs;
+    ctx->alloc_ref_defs = keep.alloc_ref_defs;
+    ctx->marks = keep.marks;
+    ctx->alloc_marks = keep.alloc_marks;
+    ctx->block_bytes = keep.block_bytes;
+    ctx->alloc_block_bytes = keep.alloc_block_bytes;
+    ctx->containers = keep.containers;
+    ctx->alloc_containers = keep.alloc_containers;
+    ctx->table_align = keep.table_align;
+    ctx->alloc_table_align = keep.alloc_table_align;
+    ctx->table_pipe_offs = keep.table_pipe_offs;
+    ctx->alloc_table_pipe_offs = keep.alloc_table_pipe_offs;
+    ctx->line_starts = keep.line_starts;
+    ctx->alloc_line_starts = keep.alloc_line_starts;
+    ctx->container_sources = keep.container_sources;
+    ctx->alloc_container_sources = keep.alloc_container_sources;
+    ctx->feed = keep.feed;
+    if(ctx->feed != NULL) {
+        ctx->feed->size = 0;
+        ctx->feed->text_off = 0;
+        ctx->feed->off = 0;
+        ctx->feed->is_open = FALSE;
+    }
+
+    md_init_stacks(ctx);
+}
+
+/* Parse with ctx, which has been just set up or reset. */
+static int
+md_parse_ctx(MD_CTX* ctx, const MD_CHAR* text, MD_SIZE size, void* userdata)
+{
+    int ret;
+
+    ctx->text = text;
+    ctx->size = size;
+    ctx->userdata = userdata;
+    ctx->doc_ends_with_newline = (size > 0  &&  ISNEWLINE_(text[size-1]));
+    ctx->max_ref_def_output = MIN(MIN(16 * (uint64_t)size, (uint64_t)(1024 * 1024)), (uint64_t)SZ_MAX);
+
+    /* All the work. */
+    ret = md_process_doc(ctx);
+
+    /* Clean-up of what refers to the document. */
+    md_free_ref_def_hashtable(ctx);
+    md_free_ref_defs(ctx);
+
+    return ret;
+}
+
+static void
+md_free_ctx(MD_CTX* ctx)
+{
+    md_free(ctx, ctx->buffer);
+    md_free(ctx, ctx->ref_defs);
+    md_free(ctx, ctx->marks);
+    md_free(ctx, ctx->block_bytes);
+    md_free(ctx, ctx->containers);
+    md_free(ctx, ctx->table_align);
+    md_free(ctx, ctx->table_pipe_offs);
+    md_free(ctx, ctx->line_starts);
+    md_free(ctx, ctx->container_sources);
+    if(ctx->feed != NULL) {
+        md_free(ctx, ctx->feed->buffer);
+        md_free(ctx, ctx->feed);
+    }
+}
+
 int
 md_parse(const MD_CHAR* text, MD_SIZE size, const MD_PARSER* parser, void* userdata)
 {
     MD_CTX ctx;
-    int i;
     int ret;
 
-    if(parser->abi_version != 0) {
+    if(md_parser_size(parser) == 0) {
         if(parser->debug_log != NULL)
             parser->debug_log("Unsupported abi_version.", userdata);
         return -1;
     }
 
-    /* Setup context structure. */
-    memset(&ctx, 0, sizeof(MD_CTX));
-    ctx.text = text;
-    ctx.size = size;
-    memcpy(&ctx.parser, parser, sizeof(MD_PARSER));
-    ctx.userdata = userdata;
-    ctx.code_indent_offset = (ctx.parser.flags & MD_FLAG_NOINDENTEDCODEBLOCKS) ? (OFF)(-1) : 4;
-    md_build_mark_char_map(&ctx);
-    ctx.doc_ends_with_newline = (size > 0  &&  ISNEWLINE_(text[size-1]));
-    ctx.max_ref_def_output = MIN(MIN(16 * (uint64_t)size, (uint64_t)(1024 * 1024)), (uint64_t)SZ_MAX);
-
-    /* Reset all mark stacks and lists. */
-    for(i = 0; i < (int) SIZEOF_ARRAY(ctx.opener_stacks); i++)
-        ctx.opener_stacks[i].top = -1;
-    ctx.ptr_stack.top = -1;
-    ctx.unresolved_link_head = -1;
-    ctx.unresolved_link_tail = -1;
-    ctx.table_cell_boundaries_head = -1;
-    ctx.table_cell_boundaries_tail = -1;
+    md_init_ctx(&ctx, parser);
+    ret = md_parse_ctx(&ctx, text, size, userdata);
+    md_free_ctx(&ctx);
 
-    /* All the work. */
-    ret = md_process_doc(&ctx);
+    return ret;
+}
+
+MD_PARSER_CTX*
+md_parser_new(const MD_PARSER* parser)
+{
+    MD_CTX* ctx;
+
+    if(md_parser_size(parser) == 0) {
+        if(parser->debug_log != NULL)
+            parser->debug_log("Unsupported abi_version.", NULL);
+        return NULL;
+    }
+
+    if(parser->abi_version >= MD_PARSER_ABI_ALLOC  &&  parser->mem_alloc != NULL)
+        ctx = (MD_CTX*) parser->mem_alloc(sizeof(MD_CTX), parser->mem_userdata);
+    else
+        ctx = (MD_CTX*) malloc(sizeof(MD_CTX));
+    if(ctx == NULL) {
+        if(parser->debug_log != NULL)
+            parser->debug_log("malloc() failed.", NULL);
+        return NULL;
+    }
 
-    /* Clean-up. */
-    md_free_ref_defs(&ctx);
-    md_free_ref_def_hashtable(&ctx);
-    free(ctx.buffer);
-    free(ctx.marks);
-    free(ctx.block_bytes);
-    free(ctx.containers);
+    md_init_ctx(ctx, parser);
+    return ctx;
+}
+
+int
+md_parser_parse(MD_PARSER_CTX* ctx, const MD_CHAR* text, MD_SIZE size, void* userdata)
+{
+    int ret;
 
+    ret = md_parse_ctx(ctx, text, size, userdata);
+    md_reset_ctx(ctx);
     return ret;
 }
+
+/* Drop the document being fed after a failure. */
+static void
+md_feed_abort(MD_CTX* ctx)
+{
+    md_free_ref_def_hashtable(ctx);
+    md_free_ref_defs(ctx);
+    md_reset_ctx(ctx);
+}
+
+/* Start a document to be fed, entering MD_BLOCK_DOC. */
+static int
+md_feed_open(MD_CTX* ctx)
+{
+    MD_FEED* feed = ctx->feed;
+    int ret = 0;
+
+    if(feed == NULL) {
+        feed = (MD_FEED*) md_malloc(ctx, sizeof(MD_FEED));
+        if(feed == NULL) {
+            MD_LOG("malloc() failed.");
+            return -1;
+        }
+        memset(feed, 0, sizeof(MD_FEED));
+        ctx->feed = feed;
+    }
+
+    feed->size = 0;
+    feed->text_off = 0;
+    feed->off = 0;
+    feed->pivot_line = &md_dummy_blank_line;
+    feed->is_open = TRUE;
+
+    ctx->text = feed->buffer;
+    ctx->size = 0;
+    ctx->doc_ends_with_newline = TRUE;
+
+    MD_CHECK(md_report_block_source(ctx, MD_BLOCK_DOC, 0, 0, 0, 0));
+    ctx->n_line_starts = 0;
+    MD_ENTER_BLOCK(MD_BLOCK_DOC, NULL);
+
+abort:
+    return ret;
+}
+
+int
+md_parser_feed(MD_PARSER_CTX* ctx, const MD_CHAR* text, MD_SIZE size, void* userdata)
+{
+    int ret = 0;
+
+    ctx->userdata = userdata;
+    if(ctx->feed == NULL  ||  !ctx->feed->is_open)
+        MD_CHECK(md_feed_open(ctx));
+
+    MD_CHECK(md_feed_append(ctx, text, size));
+
+    /* Only complete lines are analyzed: how the last one continues is not
+     * known yet. */
+    ctx->size = md_feed_complete_lines(ctx);
+    ctx->doc_ends_with_newline = TRUE;
+    MD_CHECK(md_feed_lines(ctx));
+
+abort:
+    if(ret < 0)
+        md_feed_abort(ctx);
+    return ret;
+}
+
+int
+md_parser_finish(MD_PARSER_CTX* ctx, void* userdata)
+{
+    MD_FEED* feed;
+    int ret = 0;
+
+    ctx->userdata = userdata;
+    if(ctx->feed == NULL  ||  !ctx->feed->is_open)
+        MD_CHECK(md_feed_open(ctx));
+    feed = ctx->feed;
+
+    /* The rest of the text, including a last line without a line break. */
+    ctx->size = feed->size - feed->text_off;
+    ctx->doc_ends_with_newline = (ctx->size > 0  &&  ISNEWLINE_(ctx->text[ctx->size-1]));
+    MD_CHECK(md_feed_lines(ctx));
+
+    md_end_current_block(ctx);
+    MD_CHECK(md_leave_child_containers(ctx, 0));
+    if(ctx->n_block_bytes > 0)
+        MD_CHECK(md_feed_flush(ctx));
+
+    MD_LEAVE_BLOCK(MD_BLOCK_DOC, NULL);
+
+abort:
+    md_feed_abort(ctx);
+    return ret;
+}
+
+void
+md_parser_free(MD_PARSER_CTX* ctx)
+{
+    if(ctx == NULL)
+        return;
+
+    md_free_ctx(ctx);
+    md_free(ctx, ctx);
+}
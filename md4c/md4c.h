@@ -26,6 +26,8 @@
 #ifndef MD4C_H
 #define MD4C_H
 
+#include <stddef.h>
+
 #ifdef __cplusplus
     extern "C" {
 #endif
@@ -334,10 +336,42 @@ typedef struct MD_SPAN_WIKILINK {
 #define MD_DIALECT_COMMONMARK               0
 #define MD_DIALECT_GITHUB                   (MD_FLAG_PERMISSIVEAUTOLINKS | MD_FLAG_TABLES | MD_FLAG_STRIKETHROUGH | MD_FLAG_TASKLISTS)
 
+/* Where a block is in the input, see MD_PARSER::block_source.
+ *
+ * Offsets are into the text passed to md_parse(), end is exclusive. Lines are
+ * numbered from 1; end_line is the line of the last byte of the range (the
+ * line of beg for an empty range). Line breaks are "\n", "\r" and "\r\n".
+ */
+typedef struct MD_SOURCE_RANGE {
+    MD_OFFSET beg;
+    MD_OFFSET end;
+    unsigned beg_line;
+    unsigned end_line;
+} MD_SOURCE_RANGE;
+
+typedef struct MD_BLOCK_SOURCE {
+    /* Whole lines of the block, up to the line break of the last one. This
+     * includes marks of the block and of its containers at the start of the
+     * lines, e.g. "> - " or "## ", and both fences of a fenced code block.
+     * (The underline of a Setext heading is not included.) */
+    MD_SOURCE_RANGE block;
+
+    /* Contents of the block, from the text of its first line to the end of
+     * the text of its last one. For code blocks these are the code lines
+     * only, an empty range at the end of the block if there are none. For
+     * container blocks they span from the first leaf block inside to the
+     * last one (empty without any), for table cells they are the cell text
+     * without the surrounding whitespace. */
+    MD_SOURCE_RANGE content;
+} MD_BLOCK_SOURCE;
+
+
 /* Parser structure.
  */
 typedef struct MD_PARSER {
-    /* Reserved. Set to zero.
+    /* Version of this structure the application was built with, one of the
+     * MD_PARSER_ABI_xxxx values. Members added after version 0 are only read
+     * if abi_version says they are there, so zero keeps working for old code.
      */
     unsigned abi_version;
 
@@ -380,8 +414,53 @@ typedef struct MD_PARSER {
     /* Reserved. Set to NULL.
      */
     void (*syntax)(void);
+
+    /* Memory allocator. Optional, since MD_PARSER_ABI_ALLOC.
+     *
+     * If mem_alloc is not NULL, all memory of the parser is allocated through
+     * these callbacks instead of malloc(), realloc() and free(), so the
+     * application can route it into an arena or count it. Then mem_realloc
+     * and mem_free have to be set too. mem_realloc gets the old size of the
+     * block (zero when ptr is NULL) so a bump allocator can copy it, and
+     * mem_free is never called with NULL.
+     *
+     * Note a context from md_parser_new() keeps its buffers between parses,
+     * so an arena must not be reset while the context is alive.
+     */
+    void* (*mem_alloc)(size_t /*size*/, void* /*mem_userdata*/);
+    void* (*mem_realloc)(void* /*ptr*/, size_t /*old_size*/, size_t /*new_size*/, void* /*mem_userdata*/);
+    void (*mem_free)(void* /*ptr*/, void* /*mem_userdata*/);
+    void* mem_userdata;
+
+    /* Plain text blocks. Optional (may be NULL), since MD_PARSER_ABI_PLAIN.
+     *
+     * Called before the contents of a paragraph, heading or table cell are
+     * processed, with the same arguments as enter_block. Paragraphs of tight
+     * lists, which are not reported by enter_block, are asked about too. If it
+     * returns non-zero, the lines of the block are reported as they are, as
+     * MD_TEXT_NORMAL with soft or hard breaks between them: emphasis, links,
+     * autolinks, code spans, entities and escapes are not resolved and no
+     * span callbacks are called. This saves the inline analysis for blocks
+     * whose text the application ignores or only needs raw.
+     */
+    int (*plain_text)(MD_BLOCKTYPE /*type*/, void* /*detail*/, void* /*userdata*/);
+
+    /* Source positions. Optional (may be NULL), since MD_PARSER_ABI_SOURCE.
+     *
+     * Called right before each enter_block with where the block is in the
+     * input, so the application can refer to its text in place or map it
+     * back to source lines. Like the other callbacks, it may abort parsing by
+     * returning non-zero. The structure is only valid during the call.
+     */
+    int (*block_source)(MD_BLOCKTYPE /*type*/, const MD_BLOCK_SOURCE* /*source*/, void* /*userdata*/);
 } MD_PARSER;
 
+/* Values of MD_PARSER::abi_version. */
+#define MD_PARSER_ABI_BASE                  0
+#define MD_PARSER_ABI_ALLOC                 1   /* Adds mem_alloc and friends. */
+#define MD_PARSER_ABI_PLAIN                 2   /* Adds plain_text. */
+#define MD_PARSER_ABI_SOURCE                3   /* Adds block_source. */
+
 
 /* For backward compatibility. Do not use in new code.
  */
@@ -400,6 +479,55 @@ typedef MD_PARSER MD_RENDERER;
 int md_parse(const MD_CHAR* text, MD_SIZE size, const MD_PARSER* parser, void* userdata);
 
 
+/* Reusable parser context.
+ *
+ * md_parse() allocates its internal buffers for each document and frees them
+ * at the end. An application parsing many documents in a row can instead
+ * create a context once with md_parser_new() and pass it to md_parser_parse()
+ * for each document, so the buffers stay allocated and warm between parses.
+ * Only the per-document state is reset.
+ *
+ * md_parser_new() copies the parser structure, it returns NULL on failure or
+ * if the abi_version is not supported. The context itself is allocated with
+ * the parser's allocator too. md_parser_parse() returns the same as
+ * md_parse(). A context may be used by one thread at a time.
+ */
+typedef struct MD_CTX_tag MD_PARSER_CTX;
+
+MD_PARSER_CTX* md_parser_new(const MD_PARSER* parser);
+int md_parser_parse(MD_PARSER_CTX* ctx, const MD_CHAR* text, MD_SIZE size, void* userdata);
+void md_parser_free(MD_PARSER_CTX* ctx);
+
+
+/* Streaming input.
+ *
+ * Instead of md_parser_parse(), the document may be pushed into a context in
+ * chunks of any size with md_parser_feed(), followed by md_parser_finish()
+ * once the input ends. The callbacks of the blocks on the top level of the
+ * document are called as soon as the blocks are complete, and only the text
+ * of the unfinished ones is kept, so the input does not have to fit into
+ * memory and its beginning is processed before the rest has arrived.
+ *
+ * Differences to parsing the whole document at once:
+ *   -- Link reference definitions only apply to the links which are emitted
+ *      in the same batch, i.e. up to the next top-level block boundary. A
+ *      link to a definition further down is not resolved.
+ *   -- MD_PARSER::block_source reports offsets and lines counted from the
+ *      start of the whole input, and an empty range for MD_BLOCK_DOC, whose
+ *      end is not known when it is entered. MD_BLOCK_LI_DETAIL::
+ *      task_mark_offset is counted from the start of the whole input too.
+ *   -- The text passed to the callbacks lives in a buffer of the context
+ *      which is reused, so it is only valid during the callback (as always).
+ *
+ * Both return the same as md_parse(). When either fails or a callback aborts,
+ * the rest of the document is dropped and the context is ready for a new
+ * one. userdata may be passed anew with each call. md_parser_parse() must not
+ * be called while a document is being fed.
+ */
+int md_parser_feed(MD_PARSER_CTX* ctx, const MD_CHAR* text, MD_SIZE size, void* userdata);
+int md_parser_finish(MD_PARSER_CTX* ctx, void* userdata);
+
+
 #ifdef __cplusplus
     }  /* extern "C" { */
 #endif
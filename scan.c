@@ -0,0 +1,380 @@
+#include "scan.h"
+#include "logger.h"
+#include "utils.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+// Line state carried between lines
+typedef struct {
+    char fence_char;   // Open code fence, 0 when none
+    int  fence_count;  // Length of its opening run
+    int  fence_indent; // Column of its opening run
+    int  fence_nested; // Opened in a list item or block quote
+    int  container;    // Inside a list item or block quote
+    int  prev_blank;   // Previous line was blank
+    int  prev_text;    // Previous line may continue a paragraph
+} SCAN_STATE;
+
+static int md_scan_is_space(char ch) {
+    return ch == ' ' || ch == '\t';
+}
+
+// Skip indentation, advancing column the way md4c counts it
+static const char *md_scan_indent(const char *p, const char *end, int *column) {
+    while (p < end && md_scan_is_space(*p)) {
+        *column = *p == '\t' ? (*column + 4) & ~3 : *column + 1;
+        p++;
+    }
+    return p;
+}
+
+static int md_scan_is_blank(const char *p, const char *end) {
+    while (p < end && md_scan_is_space(*p)) {
+        p++;
+    }
+    return p == end;
+}
+
+// Level of an ATX heading starting at p, 0 when it is not one
+static int md_scan_atx(const char *p, const char *end) {
+    int level = 0;
+    while (p + level < end && p[level] == '#') {
+        level++;
+    }
+    if (level < 1 || level > 6) {
+        return 0;
+    }
+    return p + level == end || md_scan_is_space(p[level]) ? level : 0;
+}
+
+// Length of the opening code fence starting at p, 0 when it is not one
+static int md_scan_fence(const char *p, const char *end) {
+    int count = 0;
+    if (p < end && (*p == '`' || *p == '~')) {
+        while (p + count < end && p[count] == *p) {
+            count++;
+        }
+    }
+    if (count < 3) {
+        return 0;
+    }
+    if (*p == '`' && memchr(p + count, '`', end - p - count)) {
+        return 0; // Code span, the info string cannot contain backticks
+    }
+    return count;
+}
+
+// Whether p closes the open fence
+static int md_scan_fence_end(SCAN_STATE *st, const char *p, const char *end) {
+    int count = 0;
+    while (p + count < end && p[count] == st->fence_char) {
+        count++;
+    }
+    return count >= st->fence_count && md_scan_is_blank(p + count, end);
+}
+
+// Setext heading underline, a heading when it follows paragraph text
+static int md_scan_setext(const char *p, const char *end) {
+    const char *q = p;
+    while (q < end && *q == *p) {
+        q++;
+    }
+    return q > p && (*p == '=' || *p == '-') && md_scan_is_blank(q, end);
+}
+
+// Link reference definition, its label is resolved document-wide
+static int md_scan_ref_def(const char *p, const char *end) {
+    if (p == end || *p != '[') {
+        return 0;
+    }
+    const char *close = memchr(p, ']', end - p);
+    return close && close + 1 < end && close[1] == ':';
+}
+
+// Skip a list item marker, returning p when there is none
+static const char *md_scan_list_marker(const char *p, const char *end) {
+    const char *q = p;
+    if (q < end && (*q == '-' || *q == '+' || *q == '*')) {
+        q++;
+    } else {
+        while (q < end && q - p < 9 && *q >= '0' && *q <= '9') {
+            q++;
+        }
+        if (q == p || q == end || (*q != '.' && *q != ')')) {
+            return p;
+        }
+        q++;
+    }
+    return q == end || md_scan_is_space(*q) ? q : p;
+}
+
+// Whether md4c passes the heading text to the callbacks unchanged. An
+// underscore between alphanumerics (env_sub) cannot start emphasis.
+static int md_scan_is_plain(const char *text, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+        if (text[i] == '_' && i > 0 && i + 1 < size && isalnum((unsigned char)text[i - 1]) && isalnum((unsigned char)text[i + 1])) {
+            continue;
+        }
+        if (text[i] == '\0' || strchr("\\`*_[]<>&!~", text[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static MD_SECTION *md_scan_add(MD_SCAN *scan, int level, size_t offset) {
+    if (scan->count == scan->capacity) {
+        scan->capacity = scan->capacity ? scan->capacity * 2 : 64;
+        scan->sections = safe_realloc(scan->sections, scan->capacity * sizeof(MD_SECTION));
+    }
+
+    MD_SECTION *section = &scan->sections[scan->count];
+    memset(section, 0, sizeof(MD_SECTION));
+    section->offset = offset;
+    section->level  = level;
+    section->parent = -1;
+
+    // Same rules as leave_block_callback()
+    if (scan->count > 0) {
+        MD_SECTION *last = section - 1;
+        if (level == last->level) {
+            section->parent    = last->parent;
+            section->is_orphan = last->is_orphan;
+        } else if (level > last->level) {
+            section->parent    = scan->count - 1;
+            section->is_orphan = last->is_orphan;
+        } else {
+            section->is_orphan = 1;
+            for (int p = last->parent; p >= 0; p = scan->sections[p].parent) {
+                if (scan->sections[p].level == level) {
+                    section->parent    = scan->sections[p].parent;
+                    section->is_orphan = scan->sections[p].is_orphan;
+                    break;
+                }
+            }
+        }
+    }
+    scan->count++;
+    return section;
+}
+
+// Record the ATX heading at p. Returns 1 once the requested section ends.
+static int md_scan_heading(MD_SCAN *scan, const char *heading, int level, const char *p, const char *end, size_t offset) {
+    if (scan->target >= 0 && level <= scan->sections[scan->target].level) {
+        scan->target_end = offset;
+        return 1;
+    }
+
+    MD_SECTION *section = md_scan_add(scan, level, offset);
+
+    // Trim the marks, the whitespace and an optional closing sequence
+    int         column = 0;
+    const char *text   = md_scan_indent(p + level, end, &column);
+    while (end > text && md_scan_is_space(end[-1])) {
+        end--;
+    }
+    const char *closing = end;
+    while (closing > text && closing[-1] == '#') {
+        closing--;
+    }
+    if (closing == text || md_scan_is_space(closing[-1])) {
+        end = closing;
+        while (end > text && md_scan_is_space(end[-1])) {
+            end--;
+        }
+    }
+    section->text      = text;
+    section->text_size = end - text;
+    section->is_plain  = md_scan_is_plain(text, end - text);
+
+    if (heading && scan->target < 0 && !section->is_orphan) {
+        if (!section->is_plain) {
+            // md4c may turn it into the requested text
+            scan->unsafe = "heading with inline markup";
+        } else if (section->text_size == strlen(heading) && strncasecmp(text, heading, section->text_size) == 0) {
+            scan->target = scan->count - 1;
+        }
+    }
+    return 0;
+}
+
+// Scan one line outside of a code fence. Returns 1 to stop scanning.
+static int md_scan_line(MD_SCAN *scan, SCAN_STATE *st, const char *heading, const char *line, const char *end) {
+    int         column = 0;
+    const char *p      = md_scan_indent(line, end, &column);
+
+    if (p == end) {
+        st->prev_blank = 1;
+        st->prev_text  = 0;
+        return 0;
+    }
+
+    int prev_blank = st->prev_blank;
+    int prev_text  = st->prev_text;
+    st->prev_blank = 0;
+    st->prev_text  = 0;
+
+    if (column < 4 || st->container) {
+        if (prev_text && md_scan_setext(p, end)) {
+            scan->unsafe = "setext heading";
+            return 1;
+        }
+    }
+
+    // Strip block quote and list item markers
+    const char *rest        = p;
+    int         rest_column = column;
+    int         markers     = 0;
+    if (column < 4 || st->container) {
+        while (rest < end) {
+            const char *marker = *rest == '>' ? rest + 1 : md_scan_list_marker(rest, end);
+            if (marker == rest) {
+                break;
+            }
+            rest_column += marker - rest;
+            rest = md_scan_indent(marker, end, &rest_column);
+            markers++;
+        }
+    }
+
+    // A line at column 0 ends all containers unless it is a lazy
+    // continuation line, which can be neither a heading nor a fence.
+    if (st->container && column == 0 && !markers) {
+        if (prev_blank || md_scan_atx(p, end) || md_scan_fence(p, end)) {
+            st->container = 0;
+        }
+    }
+    if (markers) {
+        st->container = 1;
+    }
+
+    if (!st->container) {
+        if (column >= 4) {
+            // Indented code or paragraph continuation text
+            st->prev_text = prev_text;
+            return 0;
+        }
+
+        int level = md_scan_atx(p, end);
+        if (level) {
+            return md_scan_heading(scan, heading, level, p, end, line - scan->data);
+        }
+        int count = md_scan_fence(p, end);
+        if (count) {
+            st->fence_char   = *p;
+            st->fence_count  = count;
+            st->fence_indent = column;
+            st->fence_nested = 0;
+            return 0;
+        }
+    } else if (rest < end) {
+        if (md_scan_atx(rest, end)) {
+            scan->unsafe = "heading in a list item or block quote";
+            return 1;
+        }
+        int count = md_scan_fence(rest, end);
+        if (count) {
+            st->fence_char   = *rest;
+            st->fence_count  = count;
+            st->fence_indent = rest_column;
+            st->fence_nested = 1;
+            return 0;
+        }
+    }
+
+    if (rest == end) {
+        return 0;
+    }
+    if (*rest == '<') {
+        scan->unsafe = "HTML block";
+        return 1;
+    }
+    if (md_scan_ref_def(rest, end)) {
+        scan->unsafe = "link reference definition";
+        return 1;
+    }
+
+    st->prev_text = rest < end;
+    return 0;
+}
+
+// Scan a line inside the open code fence. Returns 1 to stop scanning.
+static int md_scan_fence_line(MD_SCAN *scan, SCAN_STATE *st, const char *line, const char *end) {
+    int         column = 0;
+    const char *p      = md_scan_indent(line, end, &column);
+    if (p == end) {
+        return 0;
+    }
+
+    if (!st->fence_nested) {
+        if (column < 4 && md_scan_fence_end(st, p, end)) {
+            st->fence_char = 0;
+        }
+        return 0;
+    }
+
+    // The fence is in a list item whose content column is unknown. Lines
+    // indented less than the fence may end the item, and closing runs are
+    // only trusted at the column of the opening one.
+    if (column < st->fence_indent) {
+        scan->unsafe = "code fence in a list item";
+        return 1;
+    }
+    if (md_scan_fence_end(st, p, end)) {
+        if (column != st->fence_indent) {
+            scan->unsafe = "code fence in a list item";
+            return 1;
+        }
+        st->fence_char = 0;
+    }
+    return 0;
+}
+
+// Build the section table of data. With heading given, scanning stops at
+// the end of the first section with that heading. Returns 0 when the
+// document can be cut into sections, -1 with scan->unsafe set otherwise.
+int md_scan(MD_SCAN *scan, const char *data, size_t size, const char *heading) {
+    memset(scan, 0, sizeof(MD_SCAN));
+    scan->target     = -1;
+    scan->target_end = size;
+    scan->data       = data;
+
+    SCAN_STATE  st   = {0};
+    const char *line = data;
+    const char *end  = data + size;
+
+    // md4c skips a leading byte order mark
+    if (size >= 3 && memcmp(data, "\xEF\xBB\xBF", 3) == 0) {
+        line += 3;
+    }
+
+    while (line < end && !scan->unsafe) {
+        const char *eol = line;
+        while (eol < end && *eol != '\n' && *eol != '\r') {
+            eol++;
+        }
+
+        int stop = st.fence_char ? md_scan_fence_line(scan, &st, line, eol)
+                                 : md_scan_line(scan, &st, heading, line, eol);
+        if (stop) {
+            break;
+        }
+
+        line = eol;
+        if (line < end && *line == '\r') {
+            line++;
+        }
+        if (line < end && *line == '\n') {
+            line++;
+        }
+    }
+
+    return scan->unsafe ? -1 : 0;
+}
+
+void md_scan_free(MD_SCAN *scan) {
+    free(scan->sections);
+    memset(scan, 0, sizeof(MD_SCAN));
+}
@@ -0,0 +1,41 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+
+// Heading found by the scanner, linked the same way leave_block_callback()
+// links the nodes.
+typedef struct MD_SECTION MD_SECTION;
+struct MD_SECTION {
+    size_t      offset; // Start of the heading line
+    const char *text;   // Raw heading text, without the '#' marks
+    size_t      text_size;
+    int         level;
+    int         parent;    // Index of the parent section, -1 for none
+    int         is_orphan; // Not reachable from the root node
+    int         is_plain;  // Text has no inline markup, md4c reports it as is
+};
+
+// Section offset table of a document, built without running md4c. Only
+// headings which start a line outside of any container or code fence are
+// sections, so the document can be cut right before each of them.
+typedef struct MD_SCAN MD_SCAN;
+struct MD_SCAN {
+    const char *data;
+    MD_SECTION *sections;
+    size_t      count;
+    size_t      capacity;
+
+    // Requested heading, -1 when not found. Scanning stops at the end of its
+    // section, which is target_end.
+    int    target;
+    size_t target_end;
+
+    // Why the document cannot be cut into sections, NULL when it can
+    const char *unsafe;
+};
+
+int  md_scan(MD_SCAN *scan, const char *data, size_t size, const char *heading);
+void md_scan_free(MD_SCAN *scan);
+
+#endif
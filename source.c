@@ -0,0 +1,130 @@
+#include "source.h"
+#include "logger.h"
+#include "md4c/md4c.h"
+#include "utils.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SOURCE_READ_CHUNK (64 * 1024)
+
+static int md_source_map(MD_SOURCE *source, int fd, size_t size, int is_whole) {
+    int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    if (is_whole) {
+        flags |= MAP_POPULATE;
+    }
+#endif
+    void *data = mmap(NULL, size, PROT_READ, flags, fd, 0);
+    if (data == MAP_FAILED) {
+        return -1;
+    }
+#ifdef MADV_SEQUENTIAL
+    if (is_whole) {
+        madvise(data, size, MADV_SEQUENTIAL);
+    }
+#endif
+    source->data      = data;
+    source->size      = size;
+    source->is_mapped = 1;
+    return 0;
+}
+
+static int md_source_read(MD_SOURCE *source, int fd) {
+    size_t capacity = SOURCE_READ_CHUNK;
+    size_t size     = 0;
+    char  *data     = safe_malloc(capacity);
+
+    while (1) {
+        if (size == capacity) {
+            capacity *= 2;
+            data = safe_realloc(data, capacity);
+        }
+
+        ssize_t n = read(fd, data + size, capacity - size);
+        if (n == 0) {
+            break;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            free(data);
+            return -1;
+        }
+        size += n;
+    }
+
+    source->data      = data;
+    source->size      = size;
+    source->is_mapped = 0;
+    return 0;
+}
+
+// Load file_path, "-" stands for stdin. Returns 0 on success. Unless
+// is_whole is set, a mapped file is not read ahead, its pages are faulted in
+// as a section parse touches them.
+int md_source_load(MD_SOURCE *source, const char *file_path, int is_whole) {
+    memset(source, 0, sizeof(MD_SOURCE));
+
+    int is_stdin = strcmp(file_path, "-") == 0;
+    int fd       = is_stdin ? STDIN_FILENO : open(file_path, O_RDONLY);
+    if (fd < 0) {
+        error("Cannot open %s\n", file_path);
+        return -1;
+    }
+
+    struct stat st;
+    int         ret = -1;
+    if (fstat(fd, &st) != 0) {
+        memset(&st, 0, sizeof(st));
+    } else if (S_ISREG(st.st_mode) && st.st_size > 0) {
+        ret = md_source_map(source, fd, st.st_size, is_whole);
+    }
+    if (ret != 0) {
+        // Not mappable, e.g. a pipe
+        ret = md_source_read(source, fd);
+    }
+
+    if (!is_stdin) {
+        close(fd);
+    }
+    source->st = st;
+
+    if (ret != 0) {
+        error("Failed to read %s\n", file_path);
+        return -1;
+    }
+    if (source->size == 0) {
+        md_source_free(source);
+        error("Empty file\n");
+        return -1;
+    }
+    if (source->size > (MD_SIZE)-1) {
+        md_source_free(source);
+        error("File too large: %s\n", file_path);
+        return -1;
+    }
+    return 0;
+}
+
+// Whether file_path is better parsed while it is read: stdin when it is not
+// a regular file, e.g. a pipe from a generator. Such input is read in chunks
+// of SOURCE_READ_CHUNK, see md_parse_stream().
+int md_source_is_stream(const char *file_path) {
+    struct stat st;
+    return strcmp(file_path, "-") == 0 && (fstat(STDIN_FILENO, &st) != 0 || !S_ISREG(st.st_mode));
+}
+
+void md_source_free(MD_SOURCE *source) {
+    if (source->is_mapped) {
+        munmap(source->data, source->size);
+    } else {
+        free(source->data);
+    }
+    memset(source, 0, sizeof(MD_SOURCE));
+}
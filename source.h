@@ -0,0 +1,23 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <stddef.h>
+#include <sys/stat.h>
+
+// Markdown source loaded into memory. Regular files are mapped read-only,
+// stdin, pipes and other non-regular files are read into a growing buffer.
+typedef struct MD_SOURCE MD_SOURCE;
+struct MD_SOURCE {
+    char  *data;
+    size_t size;
+    int    is_mapped;
+
+    // The file when it was loaded, for the cache to record what it parsed
+    struct stat st;
+};
+
+int  md_source_load(MD_SOURCE *source, const char *file_path, int is_whole);
+void md_source_free(MD_SOURCE *source);
+int  md_source_is_stream(const char *file_path);
+
+#endif
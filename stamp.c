@@ -0,0 +1,277 @@
+#include "stamp.h"
+#include "cache.h"
+#include "config.h"
+#include "logger.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Inherited env entries hashed even when no code block names them, as they
+// change what runs the code blocks
+static const char *stamp_env_always[] = {"PATH"};
+
+#define STAMP_FNV_OFFSET 14695981039346656037ull
+
+// FNV-1a
+static void stamp_hash(uint64_t *hash, const void *data, size_t size) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < size; i++) {
+        *hash ^= p[i];
+        *hash *= 1099511628211ull;
+    }
+}
+
+// Hash data prefixed by its size, so neighbouring fields cannot run into
+// each other
+static void stamp_hash_field(uint64_t *hash, const void *data, size_t size) {
+    uint64_t prefix = size;
+    stamp_hash(hash, &prefix, sizeof(prefix));
+    stamp_hash(hash, data, size);
+}
+
+static void stamp_hash_str(uint64_t *hash, const char *str) {
+    stamp_hash_field(hash, str, strlen(str));
+}
+
+// Value of key in the own env table of node, NULL when it has none
+static const char *stamp_env_value(MD_DOCUMENT *doc, MD_NODE *node, const char *key) {
+    const char *value = NULL;
+    for (ENV_ENTRY *env = node->env_entry; env; env = env->next) {
+        if (md_text_equal(&env->key, key) && env->value.ptr) {
+            value = md_cstr(doc, &env->value);
+        }
+    }
+    return value;
+}
+
+// Keys of the env table which declare what the stamp covers. They are for
+// cr only and not exported to the code blocks.
+int stamp_key(const MD_TEXT *key) {
+    return md_text_equal(key, "inputs") || md_text_equal(key, "outputs");
+}
+
+static int stamp_compare_env(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static int stamp_is_name_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// Whether a code block of node names the variable key as a whole word, like
+// $KEY, ${KEY} or os.environ["KEY"]
+static int stamp_env_referenced(MD_NODE *node, const char *key, size_t len) {
+    for (CODE_BLOCK *block = node->code_block; block; block = block->next) {
+        const char *text = block->content.ptr;
+        size_t      size = block->content.size;
+        for (size_t i = 0; text && i + len <= size; i++) {
+            if (text[i] == key[0] && memcmp(text + i, key, len) == 0 && (i == 0 || !stamp_is_name_char(text[i - 1])) &&
+                (i + len == size || !stamp_is_name_char(text[i + len]))) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Whether the env entry is part of the stamp: set by the env tables from the
+// root down to node, named by its code or in stamp_env_always. The rest of
+// the inherited env (TERM, SSH_*, PWD, ...) differs from shell to shell
+// without changing what the heading does.
+static int stamp_env_hashed(MD_NODE *node, const char *entry) {
+    size_t len = strcspn(entry, "=");
+    for (size_t i = 0; i < sizeof(stamp_env_always) / sizeof(stamp_env_always[0]); i++) {
+        if (strlen(stamp_env_always[i]) == len && strncmp(stamp_env_always[i], entry, len) == 0) {
+            return 1;
+        }
+    }
+    for (MD_NODE *current = node; current; current = current->parent) {
+        for (ENV_ENTRY *env = current->env_entry; env; env = env->next) {
+            if (env->key.size == len && strncmp(env->key.ptr, entry, len) == 0) {
+                return 1;
+            }
+        }
+    }
+    return stamp_env_referenced(node, entry, len);
+}
+
+// Hash the entries of the envp of the code blocks which are part of the
+// stamp, in sorted order
+static void stamp_hash_env(uint64_t *hash, MD_NODE *node, char **envp) {
+    size_t count = 0;
+    while (envp[count]) {
+        count++;
+    }
+    char **sorted = safe_malloc((count + 1) * sizeof(char *));
+    size_t hashed = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (stamp_env_hashed(node, envp[i])) {
+            sorted[hashed++] = envp[i];
+        }
+    }
+    qsort(sorted, hashed, sizeof(char *), stamp_compare_env);
+    for (size_t i = 0; i < hashed; i++) {
+        stamp_hash_str(hash, sorted[i]);
+    }
+    free(sorted);
+}
+
+// Hash the name and content of a file, or of every file below a directory.
+// Symbolic links below a directory are hashed as links, so a link to a
+// parent does not loop.
+static void stamp_hash_path(uint64_t *hash, const char *path, int follow) {
+    struct stat st;
+    stamp_hash_str(hash, path);
+    if ((follow ? stat(path, &st) : lstat(path, &st)) != 0) {
+        stamp_hash_str(hash, "missing");
+        return;
+    }
+
+    if (S_ISLNK(st.st_mode)) {
+        char    target[PATH_MAX];
+        ssize_t len = readlink(path, target, sizeof(target));
+        stamp_hash_field(hash, target, len > 0 ? len : 0);
+    } else if (S_ISDIR(st.st_mode)) {
+        struct dirent **entries;
+        int             count = scandir(path, &entries, NULL, alphasort);
+        for (int i = 0; i < count; i++) {
+            const char *name = entries[i]->d_name;
+            if (strcmp(name, ".") != 0 && strcmp(name, "..") != 0) {
+                char child[PATH_MAX];
+                snprintf(child, sizeof(child), "%s/%s", path, name);
+                stamp_hash_path(hash, child, 0);
+            }
+            free(entries[i]);
+        }
+        if (count >= 0) {
+            free(entries);
+        }
+    } else {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            stamp_hash_str(hash, "unreadable");
+            return;
+        }
+        char    buf[64 * 1024];
+        ssize_t size;
+        while ((size = read(fd, buf, sizeof(buf))) > 0) {
+            stamp_hash(hash, buf, size);
+        }
+        close(fd);
+    }
+}
+
+// Hash the files matched by the space separated patterns, or when hash is
+// NULL, check that every pattern matches. Returns the number of patterns
+// without a match.
+static int stamp_glob(const char *patterns, uint64_t *hash) {
+    char *copy    = strdup(patterns);
+    char *save    = NULL;
+    int   missing = 0;
+    for (char *pattern = strtok_r(copy, " \t", &save); pattern; pattern = strtok_r(NULL, " \t", &save)) {
+        glob_t matches;
+        if (glob(pattern, 0, NULL, &matches) != 0) {
+            missing++;
+            if (hash) {
+                stamp_hash_str(hash, pattern);
+                stamp_hash_str(hash, "missing");
+            }
+        } else if (hash) {
+            for (size_t i = 0; i < matches.gl_pathc; i++) {
+                stamp_hash_path(hash, matches.gl_pathv[i], 1);
+            }
+        }
+        globfree(&matches);
+    }
+    free(copy);
+    return missing;
+}
+
+// Check whether the node is up to date. Otherwise its stamp is removed, so
+// a failed or interrupted run leaves none, and the hash to save after a
+// successful run is left in stamp.
+int stamp_check(MD_DOCUMENT *doc, MD_NODE *node, char **envp, char **args, int num_args, STAMP *stamp) {
+    const char *inputs  = stamp_env_value(doc, node, "inputs");
+    const char *outputs = stamp_env_value(doc, node, "outputs");
+    if (!inputs && !outputs) {
+        return STAMP_UNTRACKED;
+    }
+
+    // FNV-1a of the markdown file and the heading names the stamp
+    char dir[PATH_MAX];
+    char real_path[PATH_MAX];
+    if (md_cache_dir(dir, sizeof(dir), 1) != 0) {
+        return STAMP_UNTRACKED;
+    }
+    strncat(dir, "/stamps", sizeof(dir) - strlen(dir) - 1);
+    if (mkdir(dir, 0700) != 0 && errno != EEXIST) {
+        info("Cannot create %s\n", dir);
+        return STAMP_UNTRACKED;
+    }
+    const char *file_path = realpath(config.file_path, real_path) ? real_path : config.file_path;
+    uint64_t    name      = STAMP_FNV_OFFSET;
+    stamp_hash_field(&name, file_path, strlen(file_path));
+    stamp_hash_field(&name, node->text.ptr, node->text.size);
+    int len = snprintf(stamp->path, sizeof(stamp->path), "%s/%016llx.stamp", dir, (unsigned long long)name);
+    if (len < 0 || (size_t)len >= sizeof(stamp->path)) {
+        return STAMP_UNTRACKED;
+    }
+
+    uint64_t hash = STAMP_FNV_OFFSET;
+    for (CODE_BLOCK *block = node->code_block; block; block = block->next) {
+        stamp_hash_field(&hash, block->info.ptr, block->info.size);
+        stamp_hash_field(&hash, block->content.ptr, block->content.size);
+    }
+    stamp_hash_env(&hash, node, envp);
+    stamp_hash_field(&hash, &num_args, sizeof(num_args));
+    for (int i = 0; i < num_args; i++) {
+        stamp_hash_str(&hash, args[i]);
+    }
+    if (inputs) {
+        stamp_glob(inputs, &hash);
+    }
+    stamp->hash = hash;
+
+    if (!config.force) {
+        unsigned long long saved;
+        FILE              *file  = fopen(stamp->path, "r");
+        int                match = file && fscanf(file, "%llx", &saved) == 1 && saved == hash;
+        if (file) {
+            fclose(file);
+        }
+        if (match && (!outputs || stamp_glob(outputs, NULL) == 0)) {
+            return STAMP_UP_TO_DATE;
+        }
+        info("Out of date: %.*s\n", MD_TEXT_ARG(node->text));
+    }
+    if (unlink(stamp->path) != 0 && errno != ENOENT) {
+        info("Cannot remove stamp: %s\n", stamp->path);
+    }
+    return STAMP_OUT_OF_DATE;
+}
+
+// Record a successful run. The stamp is written under a temporary name and
+// renamed into place, like the cache files.
+void stamp_save(const STAMP *stamp) {
+    char temp_path[PATH_MAX + 8];
+    snprintf(temp_path, sizeof(temp_path), "%s.XXXXXX", stamp->path);
+    int fd = mkstemp(temp_path);
+    if (fd < 0) {
+        info("Cannot write stamp: %s\n", stamp->path);
+        return;
+    }
+    int ok = dprintf(fd, "%016llx\n", (unsigned long long)stamp->hash) > 0;
+    ok &= close(fd) == 0;
+    if (ok && rename(temp_path, stamp->path) == 0) {
+        info("Saved stamp: %s\n", stamp->path);
+    } else {
+        info("Cannot write stamp: %s\n", stamp->path);
+        unlink(temp_path);
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef STAMP_H
+#define STAMP_H
+
+#include "markdown.h"
+#include <limits.h>
+#include <stdint.h>
+
+// Up-to-date checks of headings which declare inputs or outputs in their
+// env table, as space separated file patterns. A heading is skipped when
+// the stamp of its last successful run matches the hash of its code blocks,
+// the env they read, its arguments and the content of its inputs, and all
+// of its outputs exist. Stamps are kept under $XDG_CACHE_HOME/cr/stamps,
+// one file per markdown file and heading.
+typedef struct STAMP STAMP;
+struct STAMP {
+    uint64_t hash;
+    char     path[PATH_MAX];
+};
+
+#define STAMP_UNTRACKED  (-1) // No inputs or outputs declared
+#define STAMP_OUT_OF_DATE 0
+#define STAMP_UP_TO_DATE  1
+
+int  stamp_key(const MD_TEXT *key);
+int  stamp_check(MD_DOCUMENT *doc, MD_NODE *node, char **envp, char **args, int num_args, STAMP *stamp);
+void stamp_save(const STAMP *stamp);
+
+#endif
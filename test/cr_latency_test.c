@@ -0,0 +1,213 @@
+// End to end latency of running one heading with the cr binary. For
+// runbooks of doubling size it times a cold run, with no cache, and a warm
+// run after the background parse has filled the cache, and fails when
+// either grows with the size of the document: a single heading is parsed
+// up to its section only. It also checks the printed code blocks, that the
+// cache gets filled, and that -j sees a heading added after it was.
+//
+//     cc -O2 -o /tmp/cr main.c && cc -O2 -o /tmp/cr_latency test/cr_latency_test.c && /tmp/cr_latency /tmp/cr
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_RUNS      5
+#define BENCH_MAX_RATIO 3.0
+#define BENCH_MIN_COUNT 10000
+#define BENCH_MAX_COUNT 160000
+
+static const char *cr_path;
+static char        cache_dir[] = "/tmp/cr_latency_XXXXXX";
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Run cr with args and its stdout in out, returning its exit status or -1
+static int run_cr(char *const args[], char *out, size_t size) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execv(cr_path, args);
+        _exit(127);
+    }
+    close(fds[1]);
+    size_t  len = 0;
+    ssize_t n;
+    while ((n = read(fds[0], out + len, size - 1 - len)) > 0) {
+        len += n;
+    }
+    out[len] = '\0';
+    close(fds[0]);
+
+    int status;
+    if (pid < 0 || waitpid(pid, &status, 0) != pid) {
+        return -1;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// Time `cr -f path -c heading` and check that it prints the code block
+static double time_heading(char *path, int index) {
+    char heading[32], expected[32], out[256];
+    snprintf(heading, sizeof(heading), "heading_%d", index);
+    snprintf(expected, sizeof(expected), "echo step %d\n", index);
+    char *const args[] = {"cr", "-f", path, "-c", heading, NULL};
+
+    double start = now();
+    int    ret   = run_cr(args, out, sizeof(out));
+    double time  = now() - start;
+    if (ret != 0 || strcmp(out, expected) != 0) {
+        printf("cr -c %s exited with %d and printed: %s\n", heading, ret, out);
+        return -1;
+    }
+    return time;
+}
+
+static char *write_doc(int count) {
+    static char path[] = "/tmp/cr_latency_doc_XXXXXX";
+    strcpy(path + strlen(path) - 6, "XXXXXX");
+    int   fd   = mkstemp(path);
+    FILE *file = fd < 0 ? NULL : fdopen(fd, "w");
+    if (!file) {
+        perror("write_doc");
+        exit(1);
+    }
+    fprintf(file, "# Doc\n");
+    for (int i = 0; i < count; i++) {
+        fprintf(file, "## heading_%d\n\nSome text for step %d.\n\n```sh\necho step %d\n```\n\n", i, i, i);
+    }
+    fclose(file);
+    return path;
+}
+
+// Count the cache files in the cache directory, the temporary ones being
+// written are not counted, and remove them when clear is set
+static int cache_files(int clear) {
+    char path[64], file[384];
+    snprintf(path, sizeof(path), "%s/cr", cache_dir);
+    DIR *dir   = opendir(path);
+    int  count = 0;
+    for (struct dirent *entry; dir && (entry = readdir(dir));) {
+        size_t len = strlen(entry->d_name);
+        if (len > 4 && strcmp(entry->d_name + len - 4, ".ast") == 0) {
+            snprintf(file, sizeof(file), "%s/%s", path, entry->d_name);
+            count += !clear || unlink(file) != 0;
+        }
+    }
+    if (dir) {
+        closedir(dir);
+    }
+    return count;
+}
+
+// Wait up to ten seconds for the background parse to write the cache file
+static int wait_cache() {
+    for (int i = 0; i < 1000 && !cache_files(0); i++) {
+        usleep(10000);
+    }
+    return cache_files(0) > 0;
+}
+
+// A heading appended after the cache was filled is found by -j, which
+// loads the cache, so the stale cache must not be used
+static int check_stale(char *path) {
+    FILE *file = fopen(path, "a");
+    if (!file) {
+        return 0;
+    }
+    fprintf(file, "## added\n\n```sh\necho added\n```\n");
+    fclose(file);
+
+    char        out[256];
+    char *const args[] = {"cr", "-f", path, "-c", "-j", "1", "added", NULL};
+    int         ok     = run_cr(args, out, sizeof(out)) == 0 && strcmp(out, "echo added\n") == 0;
+    printf("%-16s %s\n", "stale_cache", ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        printf("USAGE: %s CR\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    cr_path = argv[1];
+    if (!mkdtemp(cache_dir)) {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+    setenv("XDG_CACHE_HOME", cache_dir, 1);
+
+    int    ok         = 1;
+    double cold_first = 0, warm_first = 0, cold_last = 0, warm_last = 0;
+    char  *path = NULL;
+    for (int count = BENCH_MIN_COUNT; count <= BENCH_MAX_COUNT && ok; count *= 2) {
+        path = write_doc(count);
+
+        // Each cold run fills the cache in the background, it is waited for
+        // so that it does not slow down the next run
+        double cold = 0;
+        for (int run = 0; run < BENCH_RUNS && ok; run++) {
+            cache_files(1);
+            double time = time_heading(path, 0);
+            ok          = time >= 0;
+            if (ok && !wait_cache()) {
+                printf("%-16s FAIL (no cache file after the cold run)\n", "cache_fill");
+                ok = 0;
+            }
+            if (run == 0 || time < cold) {
+                cold = time;
+            }
+        }
+
+        double warm = 0;
+        for (int run = 0; run < BENCH_RUNS && ok; run++) {
+            double time = time_heading(path, 0);
+            ok          = time >= 0;
+            if (run == 0 || time < warm) {
+                warm = time;
+            }
+        }
+        ok = ok && time_heading(path, count - 1) >= 0;
+
+        printf("%-16s %8d headings  cold %8.3f ms  warm %8.3f ms\n", "heading_0", count, cold * 1e3, warm * 1e3);
+        if (count == BENCH_MIN_COUNT) {
+            cold_first = cold;
+            warm_first = warm;
+        }
+        cold_last = cold;
+        warm_last = warm;
+        if (count * 2 <= BENCH_MAX_COUNT || !ok) {
+            unlink(path);
+        }
+    }
+
+    if (ok) {
+        double cold_ratio = cold_last / cold_first;
+        double warm_ratio = warm_last / warm_first;
+        ok                = cold_ratio < BENCH_MAX_RATIO && warm_ratio < BENCH_MAX_RATIO;
+        printf("%-16s %s (cold x%.2f, warm x%.2f for x%d the headings)\n\n", "heading_0", ok ? "PASS" : "FAIL", cold_ratio,
+               warm_ratio, BENCH_MAX_COUNT / BENCH_MIN_COUNT);
+        ok = check_stale(path) && ok;
+        unlink(path);
+    }
+
+    char command[64];
+    snprintf(command, sizeof(command), "rm -rf %s", cache_dir);
+    if (system(command) != 0) {
+        printf("Cannot remove %s\n", cache_dir);
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,349 @@
+// Benchmarks for building the markdown AST.
+//
+//     cc -O2 -o /tmp/markdown_bench test/markdown_bench.c && /tmp/markdown_bench
+//
+// Each case parses generated documents of doubling size and fails when the
+// cost per item grows with the size, i.e. when it stops being linear.
+#include "../config.h"
+#include "../executor.c"
+#include "../logger.c"
+#include "../markdown.c"
+#include "../stamp.c"
+#include "../utils.c"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_RUNS      3
+#define BENCH_MAX_RATIO 3.0
+
+struct config config;
+
+typedef void (*GENERATOR)(BUFFER *doc, int count);
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void append(BUFFER *doc, const char *format, ...) {
+    char    line[256];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    buffer_append(doc, line, len);
+}
+
+static char *write_doc(BUFFER *doc) {
+    static char path[] = "/tmp/markdown_bench_XXXXXX";
+    strcpy(path + strlen(path) - 6, "XXXXXX");
+    int fd = mkstemp(path);
+    if (fd < 0 || write(fd, doc->data, doc->size) != (ssize_t)doc->size) {
+        perror("write_doc");
+        exit(1);
+    }
+    close(fd);
+    return path;
+}
+
+// Best of BENCH_RUNS parses of the file
+static double time_parse(char *path) {
+    double best = 0;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        double       start = now();
+        MD_DOCUMENT *doc   = md_parse_file(path, NULL);
+        double       time  = now() - start;
+        md_free_document(doc);
+        if (run == 0 || time < best) {
+            best = time;
+        }
+    }
+    return best;
+}
+
+static int bench_linear(const char *name, GENERATOR generate, int min_count, int max_count) {
+    double first = 0;
+    double last  = 0;
+
+    for (int count = min_count; count <= max_count; count *= 2) {
+        BUFFER doc = {0};
+        generate(&doc, count);
+        char  *path = write_doc(&doc);
+        double time = time_parse(path);
+        unlink(path);
+
+        last = time * 1e9 / count;
+        if (count == min_count) {
+            first = last;
+        }
+        printf("%-16s %8d items %10.3f ms %8.1f ns/item\n", name, count, time * 1e3, last);
+        buffer_free(&doc);
+    }
+
+    double ratio = last / first;
+    int    ok    = ratio < BENCH_MAX_RATIO;
+    printf("%-16s %s (per-item cost x%.2f)\n\n", name, ok ? "PASS" : "FAIL", ratio);
+    return ok;
+}
+
+// One code block whose lines are re-indented, so its text cannot stay a
+// view and every line goes through the content buffer.
+static void gen_code_lines(BUFFER *doc, int count) {
+    append(doc, "# Bench\n\n## code_lines\n\n- item\n\n  ```sh\n");
+    for (int i = 0; i < count; i++) {
+        append(doc, "  echo line %d\n", i);
+    }
+    append(doc, "  ```\n");
+}
+
+// One paragraph of indented lines joined by soft breaks
+static void gen_soft_breaks(BUFFER *doc, int count) {
+    append(doc, "# Bench\n\n## soft_breaks\n\n");
+    for (int i = 0; i < count; i++) {
+        append(doc, " word %d\n", i);
+    }
+}
+
+// Task list items, each one appends to the env entries of the heading
+static void gen_task_items(BUFFER *doc, int count) {
+    append(doc, "# Bench\n\n## task_items\n\n");
+    for (int i = 0; i < count; i++) {
+        append(doc, "- [x] item_%d\n", i);
+    }
+}
+
+// Single row key/value tables under one heading
+static void gen_env_tables(BUFFER *doc, int count) {
+    append(doc, "# Bench\n\n## env_tables\n\n");
+    for (int i = 0; i < count; i++) {
+        append(doc, "| key | value |\n| --- | --- |\n| key_%d | %d |\n\n", i, i);
+    }
+}
+
+// One key/value table of count rows
+static void gen_table_rows(BUFFER *doc, int count) {
+    append(doc, "# Bench\n\n## table_rows\n\n| key | value |\n| --- | --- |\n");
+    for (int i = 0; i < count; i++) {
+        append(doc, "| KEY_%d | %d |\n", i, i);
+    }
+}
+
+// Fenced code blocks under one heading
+static void gen_code_blocks(BUFFER *doc, int count) {
+    append(doc, "# Bench\n\n## code_blocks\n\n");
+    for (int i = 0; i < count; i++) {
+        append(doc, "```sh\necho %d\n```\n\n", i);
+    }
+}
+
+// Headings spread over three levels
+static void gen_headings(BUFFER *doc, int count) {
+    append(doc, "# Bench\n\n");
+    for (int i = 0; i < count; i++) {
+        append(doc, "%s Heading_%d\n\n```sh\necho %d\n```\n\n", i % 4 ? "###" : "##", i, i);
+    }
+}
+
+// Parse one table of rows rows and count the arena allocations, which must
+// not grow with the rows: cells are views and the env entries are allocated
+// at once.
+static int bench_table_rows(int rows) {
+    BUFFER doc = {0};
+    gen_table_rows(&doc, rows);
+    char *path = write_doc(&doc);
+
+    double       start  = now();
+    MD_DOCUMENT *parsed = md_parse_file(path, NULL);
+    double       time   = now() - start;
+    unlink(path);
+
+    MD_NODE *node    = md_find_heading(parsed, "table_rows");
+    int      entries = 0;
+    for (ENV_ENTRY *env = node ? node->env_entry : NULL; env; env = env->next) {
+        entries++;
+    }
+    double per_row = (double)parsed->arena.objects / rows;
+    printf("%-16s %8d rows %10.3f ms %8zu arena objects (%.4f/row)\n", "table_rows", rows, time * 1e3,
+           parsed->arena.objects, per_row);
+
+    int ok = entries == rows && per_row < 0.001;
+    printf("%-16s %s\n\n", "table_rows", ok ? "PASS" : "FAIL");
+    md_free_document(parsed);
+    buffer_free(&doc);
+    return ok;
+}
+
+// Look up headings spread over the document with the index and with the
+// depth-first search it replaced.
+static int bench_lookup(int min_count, int max_count) {
+    const int lookups = 1000;
+    double    first   = 0;
+    double    last    = 0;
+
+    for (int count = min_count; count <= max_count; count *= 2) {
+        BUFFER doc = {0};
+        gen_headings(&doc, count);
+        char        *path   = write_doc(&doc);
+        MD_DOCUMENT *parsed = md_parse_file(path, NULL);
+        unlink(path);
+
+        char names[lookups][32];
+        for (int i = 0; i < lookups; i++) {
+            snprintf(names[i], sizeof(names[i]), "heading_%d", (int)((long)i * count / lookups));
+        }
+
+        double start = now();
+        for (int round = 0; round < 100; round++) {
+            for (int i = 0; i < lookups; i++) {
+                if (!md_find_heading(parsed, names[i])) {
+                    printf("lookup: %s not found\n", names[i]);
+                    return 0;
+                }
+            }
+        }
+        double hash_time = (now() - start) / 100;
+
+        // Checking the result keeps the compiler from dropping the scan
+        start = now();
+        for (int i = 0; i < lookups; i++) {
+            if (!md_find_node(parsed, 0, names[i])) {
+                printf("lookup: %s not found by scan\n", names[i]);
+                return 0;
+            }
+        }
+        double scan_time = now() - start;
+
+        last = hash_time * 1e9 / lookups;
+        if (count == min_count) {
+            first = last;
+        }
+        printf("%-16s %8d headings %8.1f ns/lookup (scan %10.1f ns/lookup)\n", "lookup", count, last, scan_time * 1e9 / lookups);
+
+        md_free_document(parsed);
+        buffer_free(&doc);
+    }
+
+    double ratio = last / first;
+    int    ok    = ratio < BENCH_MAX_RATIO;
+    printf("%-16s %s (per-lookup cost x%.2f)\n\n", "lookup", ok ? "PASS" : "FAIL", ratio);
+    return ok;
+}
+
+// Parse only the first section of documents of doubling size, the time
+// should not depend on the size.
+static int bench_section(int min_count, int max_count) {
+    double first = 0;
+    double last  = 0;
+
+    for (int count = min_count; count <= max_count; count *= 2) {
+        BUFFER doc = {0};
+        gen_headings(&doc, count);
+        char *path = write_doc(&doc);
+
+        for (int run = 0; run < BENCH_RUNS; run++) {
+            double       start  = now();
+            MD_DOCUMENT *parsed = md_parse_file(path, "heading_0");
+            double       time   = now() - start;
+            if (!md_find_heading(parsed, "heading_0")) {
+                printf("section: heading_0 not found\n");
+                return 0;
+            }
+            md_free_document(parsed);
+            if (run == 0 || time < last) {
+                last = time;
+            }
+        }
+        unlink(path);
+
+        if (count == min_count) {
+            first = last;
+        }
+        printf("%-16s %8d headings %10.3f ms\n", "section", count, last * 1e3);
+        buffer_free(&doc);
+    }
+
+    double ratio = last / first;
+    int    ok    = ratio < BENCH_MAX_RATIO;
+    printf("%-16s %s (cost x%.2f)\n\n", "section", ok ? "PASS" : "FAIL", ratio);
+    return ok;
+}
+
+// Depth-first search over the linked nodes, as md_find_node() did before
+// the nodes were stored as arrays
+static MD_NODE *find_linked(MD_NODE *head, const char *heading) {
+    for (MD_NODE *current = head; current; current = current->next) {
+        if (md_text_case_equal(&current->text, heading)) {
+            return current;
+        }
+        MD_NODE *result = find_linked(current->child, heading);
+        if (result) {
+            return result;
+        }
+    }
+    return NULL;
+}
+
+// Search all headings for a missing one, over the node arrays and over the
+// linked nodes.
+static int bench_traversal(int count) {
+    BUFFER doc = {0};
+    gen_headings(&doc, count);
+    char        *path   = write_doc(&doc);
+    MD_DOCUMENT *parsed = md_parse_file(path, NULL);
+    unlink(path);
+
+    double array_time  = 0;
+    double linked_time = 0;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        double start = now();
+        if (md_find_node(parsed, 0, "missing")) {
+            return 0;
+        }
+        double time = now() - start;
+        if (run == 0 || time < array_time) {
+            array_time = time;
+        }
+
+        start = now();
+        if (find_linked(parsed->root, "missing")) {
+            return 0;
+        }
+        time = now() - start;
+        if (run == 0 || time < linked_time) {
+            linked_time = time;
+        }
+    }
+
+    size_t array_bytes = parsed->nodes.count * (2 * sizeof(unsigned char) + 4 * sizeof(int) + sizeof(MD_TEXT));
+    printf("%-16s %8d headings %10.3f ms (linked %10.3f ms)\n", "traversal", count, array_time * 1e3, linked_time * 1e3);
+    printf("%-16s %8zu bytes/node scanned (linked %zu)\n", "traversal", array_bytes / parsed->nodes.count, sizeof(MD_NODE));
+
+    double speedup = linked_time / array_time;
+    int    ok      = speedup > 1;
+    printf("%-16s %s (x%.1f faster)\n\n", "traversal", ok ? "PASS" : "FAIL", speedup);
+
+    md_free_document(parsed);
+    buffer_free(&doc);
+    return ok;
+}
+
+int main() {
+    config.program = "markdown_bench";
+
+    int ok = 1;
+    ok &= bench_linear("code_lines", gen_code_lines, 4096, 262144);
+    ok &= bench_linear("soft_breaks", gen_soft_breaks, 4096, 262144);
+    ok &= bench_linear("task_items", gen_task_items, 4096, 131072);
+    ok &= bench_linear("env_tables", gen_env_tables, 4096, 131072);
+    ok &= bench_linear("code_blocks", gen_code_blocks, 4096, 131072);
+    ok &= bench_linear("table_rows", gen_table_rows, 4096, 131072);
+    ok &= bench_table_rows(100000);
+    ok &= bench_lookup(32768, 262144);
+    ok &= bench_section(4096, 262144);
+    ok &= bench_traversal(1048576);
+    return ok ? 0 : 1;
+}
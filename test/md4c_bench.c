@@ -0,0 +1,459 @@
+// Benchmarks for the md4c parser API.
+//
+//     cc -O2 -o /tmp/md4c_bench test/md4c_bench.c && /tmp/md4c_bench
+//
+// reuse parses the same documents with md_parse() and with one context from
+// md_parser_new(). It fails when the callbacks differ, when the reusable
+// context does not save allocations or when it is slower.
+//
+// alloc routes the parser's memory through a counting allocator given in
+// MD_PARSER and reports the calls and peak bytes per document. It fails when
+// the callbacks differ from malloc() or when a block is leaked.
+//
+// table_rows counts the same for one table of 100k rows, it fails when the
+// parser still allocates per row.
+//
+// plain_text parses prose with and without MD_PARSER::plain_text asking for
+// the paragraphs as plain text. It fails when the raw text is not reported
+// as it is or when skipping the inline analysis is not faster.
+//
+// feed pushes a large runbook through md_parser_feed() in 64 KiB chunks, as
+// read from a pipe. It fails when the callbacks differ from md_parse() or
+// when the memory held while feeding is not a small fraction of the input.
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../md4c/md4c.c"
+
+#define BENCH_RUNS      5
+#define BENCH_MAX_RATIO 1.10 // Allowed slowdown of the reused context, for noise
+
+typedef struct {
+    char  *data;
+    size_t size;
+    size_t capacity;
+} DOC;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void append(DOC *doc, const char *format, ...) {
+    char    line[256];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+
+    if (doc->size + len + 1 > doc->capacity) {
+        doc->capacity = (doc->size + len + 1) * 2;
+        doc->data     = realloc(doc->data, doc->capacity);
+    }
+    memcpy(doc->data + doc->size, line, len + 1);
+    doc->size += len;
+}
+
+// FNV-1a over all callbacks and their arguments
+static void hash_bytes(uint64_t *hash, const void *data, size_t size) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < size; i++) {
+        *hash = (*hash ^ p[i]) * 0x100000001b3ULL;
+    }
+}
+
+static int enter_block(MD_BLOCKTYPE type, void *detail, void *userdata) {
+    hash_bytes(userdata, "B", 1);
+    hash_bytes(userdata, &type, sizeof(type));
+    return 0;
+}
+
+static int leave_block(MD_BLOCKTYPE type, void *detail, void *userdata) {
+    hash_bytes(userdata, "b", 1);
+    hash_bytes(userdata, &type, sizeof(type));
+    return 0;
+}
+
+static int enter_span(MD_SPANTYPE type, void *detail, void *userdata) {
+    hash_bytes(userdata, "S", 1);
+    hash_bytes(userdata, &type, sizeof(type));
+    if (type == MD_SPAN_A) {
+        MD_SPAN_A_DETAIL *a = detail;
+        hash_bytes(userdata, a->href.text, a->href.size);
+        hash_bytes(userdata, a->title.text, a->title.size);
+    }
+    return 0;
+}
+
+static int leave_span(MD_SPANTYPE type, void *detail, void *userdata) {
+    hash_bytes(userdata, "s", 1);
+    hash_bytes(userdata, &type, sizeof(type));
+    return 0;
+}
+
+static int text(MD_TEXTTYPE type, const MD_CHAR *data, MD_SIZE size, void *userdata) {
+    hash_bytes(userdata, "T", 1);
+    hash_bytes(userdata, &type, sizeof(type));
+    hash_bytes(userdata, data, size);
+    return 0;
+}
+
+// Counting allocator, each block is prefixed with its size
+typedef struct {
+    size_t allocs;
+    size_t reallocs;
+    size_t frees;
+    size_t live; // Bytes
+    size_t peak;
+} ALLOC_STATS;
+
+#define ALLOC_HEADER sizeof(max_align_t)
+
+static void *count_alloc(size_t size, void *userdata) {
+    ALLOC_STATS *stats = userdata;
+    char        *block = malloc(ALLOC_HEADER + size);
+    if (!block) {
+        return NULL;
+    }
+    *(size_t *)block = size;
+    stats->allocs++;
+    stats->live += size;
+    stats->peak = stats->live > stats->peak ? stats->live : stats->peak;
+    return block + ALLOC_HEADER;
+}
+
+static void *count_realloc(void *ptr, size_t old_size, size_t new_size, void *userdata) {
+    ALLOC_STATS *stats = userdata;
+    char        *block = ptr ? (char *)ptr - ALLOC_HEADER : NULL;
+    if (block && *(size_t *)block != old_size) {
+        printf("realloc() of %zu bytes with old_size %zu\n", *(size_t *)block, old_size);
+        exit(EXIT_FAILURE);
+    }
+    block = realloc(block, ALLOC_HEADER + new_size);
+    if (!block) {
+        return NULL;
+    }
+    *(size_t *)block = new_size;
+    stats->reallocs++;
+    stats->live += new_size - old_size;
+    stats->peak = stats->live > stats->peak ? stats->live : stats->peak;
+    return block + ALLOC_HEADER;
+}
+
+static void count_free(void *ptr, void *userdata) {
+    ALLOC_STATS *stats = userdata;
+    char        *block = (char *)ptr - ALLOC_HEADER;
+    stats->frees++;
+    stats->live -= *(size_t *)block;
+    free(block);
+}
+
+static const MD_PARSER parser = {
+    .flags       = MD_DIALECT_GITHUB,
+    .enter_block = enter_block,
+    .leave_block = leave_block,
+    .enter_span  = enter_span,
+    .leave_span  = leave_span,
+    .text        = text,
+};
+
+// The same parser with the counting allocator
+static MD_PARSER counting_parser(ALLOC_STATS *stats) {
+    MD_PARSER counting    = parser;
+    counting.abi_version  = MD_PARSER_ABI_ALLOC;
+    counting.mem_alloc    = count_alloc;
+    counting.mem_realloc  = count_realloc;
+    counting.mem_free     = count_free;
+    counting.mem_userdata = stats;
+    return counting;
+}
+
+// A runbook with a bit of everything md4c keeps buffers for: nested lists
+// (containers), inline markup (marks), reference links (ref defs), tables and
+// code (block bytes).
+static void gen_section(DOC *doc, int i, int seed) {
+    append(doc, "## Step %d\n\nRun *this* step with `make step_%d` and check **all** output.\n\n", i, i);
+    append(doc, "- item one\n  - nested [link](https://example.com/%d)\n- [x] done\n\n", i);
+    append(doc, "| key | value |\n|-----|-------|\n| STEP | %d |\n| SEED | %d |\n\n", i, seed);
+    append(doc, "```sh\nfor i in 1 2 3; do\n    echo \"step %d: $i\"\ndone\n```\n\n", i);
+    append(doc, "> Note: ~~old~~ new behaviour &amp; <b>html</b>.\n\n");
+}
+
+static void gen_runbook(DOC *doc, int sections, int seed) {
+    append(doc, "# Runbook %d\n\nSee [the docs][docs] and [status][%d].\n\n", seed, seed % 3);
+    for (int i = 0; i < sections; i++) {
+        gen_section(doc, i, seed);
+    }
+    append(doc, "[docs]: https://example.com/docs \"Docs\"\n[%d]: https://example.com/status\n", seed % 3);
+}
+
+static uint64_t parse_with(const MD_PARSER *with, const DOC *doc) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    md_parse(doc->data, doc->size, with, &hash);
+    return hash;
+}
+
+static uint64_t parse_fresh(const DOC *doc) {
+    return parse_with(&parser, doc);
+}
+
+static uint64_t parse_reused(MD_PARSER_CTX *ctx, const DOC *doc) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    md_parser_parse(ctx, doc->data, doc->size, &hash);
+    return hash;
+}
+
+// Parse docs count times over, with ctx or with md_parse() when it is NULL
+static double time_parses(MD_PARSER_CTX *ctx, DOC *docs, int n_docs, int count) {
+    double start = now();
+    for (int i = 0; i < count; i++) {
+        if (ctx) {
+            parse_reused(ctx, &docs[i % n_docs]);
+        } else {
+            parse_fresh(&docs[i % n_docs]);
+        }
+    }
+    return now() - start;
+}
+
+static int bench_reuse(const char *name, int sections, int count) {
+    // Documents of different content, so the context sees changing sizes
+    DOC docs[4] = {0};
+    for (int i = 0; i < 4; i++) {
+        gen_runbook(&docs[i], sections + i, i);
+    }
+
+    MD_PARSER_CTX *ctx = md_parser_new(&parser);
+    int            ok  = 1;
+    for (int i = 0; i < 8; i++) {
+        if (parse_fresh(&docs[i % 4]) != parse_reused(ctx, &docs[i % 4])) {
+            printf("%-16s callbacks differ for document %d\n", name, i % 4);
+            ok = 0;
+        }
+    }
+
+    // Allocations per parse, once the context has seen all documents
+    ALLOC_STATS    stats    = {0};
+    MD_PARSER      counting = counting_parser(&stats);
+    MD_PARSER_CTX *counted  = md_parser_new(&counting);
+    for (int i = 0; i < 4; i++) {
+        parse_reused(counted, &docs[i]);
+    }
+    stats = (ALLOC_STATS){0};
+    for (int i = 0; i < 4; i++) {
+        parse_with(&counting, &docs[i]);
+    }
+    double fresh_allocs = (stats.allocs + stats.reallocs) / 4.0;
+    stats               = (ALLOC_STATS){0};
+    for (int i = 0; i < 4; i++) {
+        parse_reused(counted, &docs[i]);
+    }
+    double reused_allocs = (stats.allocs + stats.reallocs) / 4.0;
+    md_parser_free(counted);
+
+    // Best of BENCH_RUNS, alternating so both see the same machine load
+    double fresh  = 0;
+    double reused = 0;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        double time = time_parses(NULL, docs, 4, count);
+        fresh       = run == 0 || time < fresh ? time : fresh;
+        time        = time_parses(ctx, docs, 4, count);
+        reused      = run == 0 || time < reused ? time : reused;
+    }
+    md_parser_free(ctx);
+
+    printf("%-16s %8d x %7zu bytes  md_parse %8.3f ms %6.1f allocs  reused %8.3f ms %6.1f allocs\n", name, count,
+           docs[0].size, fresh * 1e3, fresh_allocs, reused * 1e3, reused_allocs);
+    ok = ok && reused_allocs < fresh_allocs && reused < fresh * BENCH_MAX_RATIO;
+    printf("%-16s %s (x%.2f faster)\n\n", name, ok ? "PASS" : "FAIL", fresh / reused);
+
+    for (int i = 0; i < 4; i++) {
+        free(docs[i].data);
+    }
+    return ok;
+}
+
+static int bench_alloc(const char *name, int sections) {
+    DOC doc = {0};
+    gen_runbook(&doc, sections, 0);
+
+    ALLOC_STATS stats    = {0};
+    MD_PARSER   counting = counting_parser(&stats);
+    int         ok       = parse_with(&counting, &doc) == parse_fresh(&doc) && stats.live == 0;
+
+    printf("%-16s %7zu bytes  %5zu malloc %5zu realloc %5zu free  peak %8zu bytes\n", name, doc.size, stats.allocs,
+           stats.reallocs, stats.frees, stats.peak);
+    printf("%-16s %s\n\n", name, ok ? "PASS" : "FAIL");
+    free(doc.data);
+    return ok;
+}
+
+// One key/value table of rows rows, as generated env tables are
+static void gen_table(DOC *doc, int rows) {
+    append(doc, "# Env\n\n| key | value |\n| --- | --- |\n");
+    for (int i = 0; i < rows; i++) {
+        append(doc, "| KEY_%d | `value %d` |\n", i, i);
+    }
+}
+
+static int bench_table_rows(const char *name, int rows) {
+    DOC doc = {0};
+    gen_table(&doc, rows);
+
+    ALLOC_STATS stats    = {0};
+    MD_PARSER   counting = counting_parser(&stats);
+    double      start    = now();
+    uint64_t    hash     = parse_with(&counting, &doc);
+    double      time     = now() - start;
+    size_t      calls    = stats.allocs + stats.reallocs;
+    int         ok       = hash == parse_fresh(&doc) && stats.live == 0 && calls < rows / 1000;
+
+    printf("%-16s %7d rows %8.3f ms  %5zu malloc %5zu realloc  %.4f allocs/row  peak %8zu bytes\n", name, rows,
+           time * 1e3, stats.allocs, stats.reallocs, (double)calls / rows, stats.peak);
+    printf("%-16s %s\n\n", name, ok ? "PASS" : "FAIL");
+    free(doc.data);
+    return ok;
+}
+
+// A runbook as a generator would pipe it. No reference links, their
+// definitions only apply to the blocks fed with them.
+static void gen_stream(DOC *doc, int sections) {
+    append(doc, "# Generated runbook\n\n");
+    for (int i = 0; i < sections; i++) {
+        gen_section(doc, i, 0);
+    }
+}
+
+static uint64_t feed_with(MD_PARSER_CTX *ctx, const DOC *doc, size_t chunk) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t off = 0; off < doc->size; off += chunk) {
+        md_parser_feed(ctx, doc->data + off, doc->size - off < chunk ? doc->size - off : chunk, &hash);
+    }
+    md_parser_finish(ctx, &hash);
+    return hash;
+}
+
+static int bench_feed(const char *name, int sections) {
+    DOC doc = {0};
+    gen_stream(&doc, sections);
+
+    // Whole document: the input is held next to the parser's memory
+    ALLOC_STATS whole          = {0};
+    MD_PARSER   whole_counting = counting_parser(&whole);
+    double      start          = now();
+    uint64_t    expected       = parse_with(&whole_counting, &doc);
+    double      whole_time     = now() - start;
+
+    ALLOC_STATS    fed          = {0};
+    MD_PARSER      fed_counting = counting_parser(&fed);
+    MD_PARSER_CTX *ctx          = md_parser_new(&fed_counting);
+    start                       = now();
+    uint64_t hash               = feed_with(ctx, &doc, 64 * 1024);
+    double   fed_time           = now() - start;
+    md_parser_free(ctx);
+
+    size_t whole_peak = doc.size + whole.peak;
+    size_t fed_peak   = 64 * 1024 + fed.peak; // The chunk read plus the parser
+    int    ok         = hash == expected && fed.live == 0 && fed_peak * 10 < whole_peak;
+
+    printf("%-16s %9zu bytes  md_parse %8.3f ms  peak %9zu bytes  fed %8.3f ms  peak %9zu bytes\n", name, doc.size,
+           whole_time * 1e3, whole_peak, fed_time * 1e3, fed_peak);
+    printf("%-16s %s (x%.1f less memory)\n\n", name, ok ? "PASS" : "FAIL", (double)whole_peak / fed_peak);
+    free(doc.data);
+    return ok;
+}
+
+// Paragraphs as plain text
+static int plain_paragraphs(MD_BLOCKTYPE type, void *detail, void *userdata) {
+    return type == MD_BLOCK_P;
+}
+
+// Collects the text of the plain paragraphs
+static int append_text(MD_TEXTTYPE type, const MD_CHAR *data, MD_SIZE size, void *userdata) {
+    append(userdata, "%d:%.*s|", type, (int)size, data);
+    return 0;
+}
+
+static int ignore_block(MD_BLOCKTYPE type, void *detail, void *userdata) {
+    return 0;
+}
+
+// Records spans, which plain paragraphs must not have
+static int record_span(MD_SPANTYPE type, void *detail, void *userdata) {
+    append(userdata, "span %d|", type);
+    return 0;
+}
+
+// Prose with a bit of inline markup in every line
+static void gen_prose(DOC *doc, int paragraphs) {
+    for (int i = 0; i < paragraphs; i++) {
+        append(doc, "## Step %d\n\n", i);
+        append(doc, "Before you *start*, read the [runbook](https://example.com/%d) and check\n", i);
+        append(doc, "that `kubectl` points to **staging** &amp; not to production. Ask in\n");
+        append(doc, "#ops or mail ops@example.com, see also www.example.com/faq_%d for _more_.\n\n", i);
+    }
+}
+
+static int bench_plain_text(const char *name, int paragraphs) {
+    static const char text_md[] = "# Title\n\na *b* [c](d) &amp;\\\nnext  \nlast `x`\n";
+    static const char expected[] = "0:Title|0:a *b* [c](d) &amp;\\|3:\n|0:next|2:\n|0:last `x`|";
+
+    MD_PARSER raw   = parser;
+    raw.abi_version = MD_PARSER_ABI_PLAIN;
+    raw.plain_text  = plain_paragraphs;
+
+    // The lines as they are, with the breaks of md4c between them
+    DOC       out       = {0};
+    MD_PARSER collect   = raw;
+    collect.enter_block = ignore_block;
+    collect.leave_block = ignore_block;
+    collect.enter_span  = record_span;
+    collect.leave_span  = record_span;
+    collect.text        = append_text;
+    append(&out, "");
+    md_parse(text_md, sizeof(text_md) - 1, &collect, &out);
+    int ok = strcmp(out.data, expected) == 0;
+    if (!ok) {
+        printf("%-16s got %s\n", name, out.data);
+    }
+    free(out.data);
+
+    DOC doc = {0};
+    gen_prose(&doc, paragraphs);
+
+    double full  = 0;
+    double plain = 0;
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        double start = now();
+        parse_with(&parser, &doc);
+        double time = now() - start;
+        full        = run == 0 || time < full ? time : full;
+        start       = now();
+        parse_with(&raw, &doc);
+        time  = now() - start;
+        plain = run == 0 || time < plain ? time : plain;
+    }
+
+    printf("%-16s %7zu bytes  inlines %8.3f ms  plain %8.3f ms\n", name, doc.size, full * 1e3, plain * 1e3);
+    ok = ok && plain < full;
+    printf("%-16s %s (x%.2f faster)\n\n", name, ok ? "PASS" : "FAIL", full / plain);
+    free(doc.data);
+    return ok;
+}
+
+int main() {
+    int ok = 1;
+    ok &= bench_alloc("alloc_small", 2);
+    ok &= bench_alloc("alloc_large", 2000);
+    ok &= bench_table_rows("table_rows", 100000);
+    ok &= bench_plain_text("plain_text", 20000);
+    ok &= bench_feed("feed", 50000);
+    ok &= bench_reuse("reuse_small", 2, 20000);
+    ok &= bench_reuse("reuse_large", 2000, 20);
+    return ok ? 0 : 1;
+}
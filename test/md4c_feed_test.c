@@ -0,0 +1,189 @@
+// Differential test of md_parser_feed() against md_parse() of the whole
+// input, with the input fed in chunks from a byte up to pages and of random
+// sizes. Also checks that blocks are emitted before the input ends, that the
+// fed text does not pile up and that an aborted document leaves the context
+// reusable.
+//
+//     cc -O2 -o md4c_feed_test test/md4c_feed_test.c && ./md4c_feed_test
+
+#include "../md4c/md4c.c"
+#include "md4c_stream.h"
+
+// The document has no known end while it is fed, so its range is left out
+static int block_source(MD_BLOCKTYPE type, const MD_BLOCK_SOURCE *source, void *userdata) {
+    return type == MD_BLOCK_DOC ? 0 : stream_block_source(type, source, userdata);
+}
+
+static MD_PARSER make_parser(void) {
+    MD_PARSER parser    = stream_parser(MD_DIALECT_GITHUB);
+    parser.abi_version  = MD_PARSER_ABI_SOURCE;
+    parser.block_source = block_source;
+    return parser;
+}
+
+static int failures = 0;
+
+// Feed data in chunks of chunk bytes, or of random sizes up to -chunk
+static int feed(MD_PARSER_CTX *ctx, const char *data, size_t size, int chunk, STREAM *out) {
+    size_t off = 0;
+    while (off < size) {
+        size_t n = chunk > 0 ? (size_t)chunk : 1 + (size_t)rand() % (size_t)-chunk;
+        if (n > size - off) {
+            n = size - off;
+        }
+        int ret = md_parser_feed(ctx, data + off, n, out);
+        if (ret != 0) {
+            return ret;
+        }
+        off += n;
+    }
+    return md_parser_finish(ctx, out);
+}
+
+static void check(MD_PARSER_CTX *ctx, const char *name, const char *data, size_t size) {
+    static STREAM    expected, actual;
+    static const int chunks[] = {1, 2, 3, 7, 64, 4096, -16, -300};
+    MD_PARSER        parser   = make_parser();
+
+    stream_reset(&expected);
+    int ret = md_parse(data, size, &parser, &expected);
+
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        stream_reset(&actual);
+        int actual_ret = feed(ctx, data, size, chunks[c], &actual);
+        if (actual_ret != ret || actual.size != expected.size || memcmp(actual.data, expected.data, actual.size) != 0) {
+            printf("FAIL %s: fed in chunks of %d differs from md_parse()\n", name, chunks[c]);
+            failures++;
+            return;
+        }
+    }
+}
+
+// Lines of markdown constructs, nested at random. No link reference
+// definitions, they only apply to the links emitted with them.
+static char *generate(unsigned seed) {
+    static const char *prefixes[] = {"", "", "", "> ", "- ", "1. ", "  ", "    ", "- [x] ", "> > "};
+    static const char *lines[]    = {
+        "text *with* _marks_ and [a link](/url)", "# Heading", "## Heading ##", "```sh", "```", "~~~", "code",
+        "", "", "| a | b |", "|---|---|", "| 1 | 2 |", "---", "<div>", "</div>", "Setext", "===",
+        "\t\tindented", "<!-- comment", "-->", "text\r", "\xC3\xA9t\xC3\xA9 &amp; `code`",
+    };
+    static const char *breaks[] = {"\n", "\n", "\n", "\r\n", "\r"};
+    char              *data     = malloc(64 * 1024);
+    size_t             size     = 0;
+    srand(seed);
+    int count = rand() % 80;
+    for (int i = 0; i < count; i++) {
+        size += sprintf(data + size, "%s%s%s", prefixes[rand() % 10], lines[rand() % 22],
+                        i + 1 < count || rand() % 2 ? breaks[rand() % 5] : "");
+    }
+    data[size] = '\0';
+    return data;
+}
+
+// Blocks of a runbook are emitted while it is fed, and the fed text does
+// not grow beyond the largest block
+static void check_streaming(MD_PARSER_CTX *ctx) {
+    static STREAM out;
+    static const char section[] = "## Step\n\nRun the step.\n\n```sh\necho step\n```\n\n| key | value |\n|---|---|\n| A | 1 |\n\n";
+
+    stream_reset(&out);
+    if (md_parser_feed(ctx, "# Title\n\nIntro", 14, &out) != 0 || out.blocks != 2) {
+        printf("FAIL streaming: heading not emitted before the paragraph is complete (%d blocks)\n", out.blocks);
+        failures++;
+    }
+    if (md_parser_feed(ctx, " text\n\n", 7, &out) != 0 || out.blocks != 3) {
+        printf("FAIL streaming: paragraph not emitted after the blank line (%d blocks)\n", out.blocks);
+        failures++;
+    }
+
+    size_t max_alloc = 0;
+    for (int i = 0; i < 20000; i++) {
+        if (md_parser_feed(ctx, section, sizeof(section) - 1, &out) != 0) {
+            printf("FAIL streaming: md_parser_feed() failed\n");
+            failures++;
+            break;
+        }
+        if (ctx->feed->alloc_buffer > max_alloc) {
+            max_alloc = ctx->feed->alloc_buffer;
+        }
+        out.size = 0;
+    }
+    md_parser_finish(ctx, &out);
+
+    if (max_alloc > 4096) {
+        printf("FAIL streaming: fed text grew to %zu bytes\n", max_alloc);
+        failures++;
+    }
+    printf("streaming %d blocks of %zu bytes, feed buffer at most %zu bytes\n", out.blocks,
+           20000 * (sizeof(section) - 1), max_alloc);
+}
+
+// A callback aborting in the middle leaves the context ready for a new
+// document. md4c only unwinds on negative values.
+static int abort_on_code(MD_BLOCKTYPE type, void *detail, void *userdata) {
+    return type == MD_BLOCK_CODE ? -42 : stream_enter_block(type, detail, userdata);
+}
+
+static void check_abort(void) {
+    static STREAM  out, expected;
+    MD_PARSER      parser = make_parser();
+    parser.enter_block    = abort_on_code;
+    MD_PARSER_CTX *ctx    = md_parser_new(&parser);
+
+    const char doc[] = "# A\n\n```\ncode\n```\n\n# B\n";
+    int        ret   = feed(ctx, doc, sizeof(doc) - 1, 5, &out);
+    stream_reset(&out);
+    int again = feed(ctx, "# C\n", 4, 1, &out);
+    md_parse("# C\n", 4, &parser, &expected);
+    if (ret != -42 || again != 0 || out.size != expected.size || memcmp(out.data, expected.data, out.size) != 0) {
+        printf("FAIL abort: returned %d, then %d with \"%.*s\"\n", ret, again, (int)out.size, out.data);
+        failures++;
+    }
+    md_parser_free(ctx);
+}
+
+int main(void) {
+    static const char *cases[][2] = {
+        {"empty", ""},
+        {"no_newline", "text without a line break"},
+        {"blank_lines", "\n\n\r\n\r\r\n\n"},
+        {"headings", "# One\n## Two\ntext\n# Three"},
+        {"paragraphs", "a\nb\n\nc\r\nd\r\n\r\ne\rf\r\rg"},
+        {"setext", "Title\n=====\n\nSub\n---\n"},
+        {"fence", "```sh\necho a\n\n\necho b\n```\nafter\n"},
+        {"unclosed_fence", "text\n\n~~~\ncode\n\n"},
+        {"indented", "    code\n\n    more\n\ntext\n"},
+        {"list", "- a\n\n- b\n\n  c\n- d\ntext\n\n1. x\n2. y\n"},
+        {"quote", "> a\n>\n> b\n\n> c\nlazy\n"},
+        {"table", "| a | b |\n|---|---|\n| 1 | 2 |\n\n| c |\n|---|\n"},
+        {"html", "<div>\n\n*x*\n</div>\n\n<!--\n\ncomment\n-->\n"},
+        {"ref_def_before", "[x]: /url\n[x]\n\n> [y]: /y 'title'\n>\n> [y]\n"},
+    };
+
+    MD_PARSER      parser = make_parser();
+    MD_PARSER_CTX *ctx    = md_parser_new(&parser);
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        check(ctx, cases[i][0], cases[i][1], strlen(cases[i][1]));
+    }
+
+    for (unsigned seed = 1; seed <= 500; seed++) {
+        char name[32];
+        snprintf(name, sizeof(name), "random_%u", seed);
+        char *data = generate(seed);
+        check(ctx, name, data, strlen(data));
+        free(data);
+    }
+
+    check_streaming(ctx);
+    check_abort();
+    md_parser_free(ctx);
+
+    if (failures) {
+        printf("FAIL %d\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("PASS\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,212 @@
+// Differential test of the line scanning ahead of md_analyze_line(). The
+// line breaks md_scan_lines() finds with each scan variant the CPU supports,
+// and the documents parsed with it, must match the scalar scan over line
+// ending, indentation and line length edge cases.
+//
+//     cc -O2 -o md4c_lines_test test/md4c_lines_test.c && ./md4c_lines_test
+
+#include "../md4c/md4c.c"
+#include "md4c_stream.h"
+
+static int parse(const char *data, size_t size, int variant, STREAM *out) {
+    MD_PARSER parser = stream_parser(MD_DIALECT_GITHUB);
+    if (out) {
+        stream_reset(out);
+    }
+    md_simd_max = variant;
+    int ret     = md_parse(data, size, &parser, out);
+    md_simd_max = MD_SIMD_AVX2;
+    return ret;
+}
+
+static const char *variant_names[] = {"scalar", "sse2", "avx2"};
+
+static int failures = 0;
+
+// All line breaks of data as md_scan_lines() finds them with variant
+static MD_LINE_BREAK *scan_all(const char *data, size_t size, int variant, size_t *count) {
+    MD_CTX ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.text                  = data;
+    ctx.size                  = size;
+    ctx.simd                  = variant;
+    ctx.doc_ends_with_newline = size > 0 && ISNEWLINE_(data[size - 1]);
+
+    MD_LINE_BREAK *all = malloc((size + 1) * sizeof(MD_LINE_BREAK));
+    *count             = 0;
+    OFF off            = 0;
+    while (off < size) {
+        md_scan_lines(&ctx, off);
+        memcpy(all + *count, ctx.line_breaks, ctx.n_line_breaks * sizeof(MD_LINE_BREAK));
+        *count += ctx.n_line_breaks;
+
+        // Continue after the line break of the last line
+        off = ctx.line_breaks[ctx.n_line_breaks - 1].end;
+        off += off < size && data[off] == '\r';
+        off += off < size && data[off] == '\n';
+    }
+    return all;
+}
+
+static void check(const char *name, const char *data, size_t size) {
+    static STREAM  expected, actual;
+    int            variants = md_simd_level();
+    size_t         expected_count;
+    MD_LINE_BREAK *expected_breaks = scan_all(data, size, MD_SIMD_SCALAR, &expected_count);
+    int            ret             = parse(data, size, MD_SIMD_SCALAR, &expected);
+
+    for (int v = MD_SIMD_SSE2; v <= variants; v++) {
+        size_t         count;
+        MD_LINE_BREAK *breaks = scan_all(data, size, v, &count);
+        if (count != expected_count || memcmp(breaks, expected_breaks, count * sizeof(MD_LINE_BREAK)) != 0) {
+            printf("FAIL %s: %s finds other line breaks than scalar\n", name, variant_names[v]);
+            failures++;
+        }
+        free(breaks);
+
+        int actual_ret = parse(data, size, v, &actual);
+        if (actual_ret != ret || actual.size != expected.size || memcmp(actual.data, expected.data, actual.size) != 0) {
+            printf("FAIL %s: %s differs from scalar\n", name, variant_names[v]);
+            failures++;
+        }
+    }
+    free(expected_breaks);
+}
+
+// Lines of random length and indentation, joined by random line breaks
+static char *generate(size_t len, unsigned seed) {
+    static const char *breaks[]  = {"\n", "\r\n", "\r", "\n\n", "\r\r\n"};
+    static const char *indents[] = {"", " ", "  ", "    ", "\t", " \t", "\t\t  ", "        "};
+    char              *data      = malloc(len + 256);
+    size_t             size      = 0;
+    srand(seed);
+    while (size < len) {
+        size += sprintf(data + size, "%s", indents[rand() % 8]);
+        int width = rand() % 5 == 0 ? rand() % 200 : rand() % 70;
+        for (int i = 0; i < width; i++) {
+            data[size++] = "abcdefgh   -*>#`~|"[rand() % 18];
+        }
+        size += sprintf(data + size, "%s", breaks[rand() % 5]);
+    }
+    data[size] = '\0';
+    return data;
+}
+
+// A runbook made mostly of fenced code blocks
+static char *generate_code(size_t len) {
+    static const char *code[] = {
+        "    if [ -z \"$TARGET\" ]; then",
+        "        echo \"usage: deploy <target>\" >&2",
+        "        exit 1",
+        "    fi",
+        "    kubectl --context \"$TARGET\" rollout status deployment/api --timeout=300s",
+        "",
+        "    for node in $(kubectl get nodes -o name); do",
+        "        kubectl drain \"$node\" --ignore-daemonsets --delete-emptydir-data",
+        "    done",
+    };
+    char  *data = malloc(len + 4096);
+    size_t size = 0;
+    int    n    = 0;
+    while (size < len) {
+        size += sprintf(data + size, "## Step %d\n\nRun the step.\n\n```sh\n", n++);
+        for (int i = 0; i < 200; i++) {
+            size += sprintf(data + size, "%s\n", code[i % 9]);
+        }
+        size += sprintf(data + size, "```\n\n");
+    }
+    data[size] = '\0';
+    return data;
+}
+
+static void bench_parse(const char *data, size_t size, int variant) {
+    parse(data, size, variant, NULL);
+}
+
+// md_scan_lines() over the whole document, the way md_analyze_line() calls it
+static void bench_scan(const char *data, size_t size, int variant) {
+    MD_CTX ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.text                  = data;
+    ctx.size                  = size;
+    ctx.simd                  = variant;
+    ctx.doc_ends_with_newline = size > 0 && ISNEWLINE_(data[size - 1]);
+
+    OFF off = 0;
+    while (off < size) {
+        md_scan_lines(&ctx, off);
+        off = ctx.line_breaks[ctx.n_line_breaks - 1].end;
+        off += off < size && data[off] == '\r';
+        off += off < size && data[off] == '\n';
+    }
+}
+
+// Counting the lines with memchr() for reference
+static volatile size_t line_count;
+
+static void bench_memchr(const char *data, size_t size, int variant) {
+    size_t count = 0;
+    for (const char *p = data; (p = memchr(p, '\n', data + size - p)); p++) {
+        count++;
+    }
+    line_count = count;
+}
+
+static void bench(const char *data, size_t size) {
+    double mib = size / (1024.0 * 1024.0);
+    printf("Fenced code, %.0f MiB:\n", mib);
+    printf("  memchr %7.2f ms line count (%.0f MiB/s)\n", best_of(bench_memchr, data, size, 0),
+           mib * 1000 / best_of(bench_memchr, data, size, 0));
+    for (int v = MD_SIMD_SCALAR; v <= md_simd_level(); v++) {
+        double scan = best_of(bench_scan, data, size, v);
+        printf("  %-6s %7.2f ms parse, %6.2f ms line scan (%.0f MiB/s)\n", variant_names[v],
+               best_of(bench_parse, data, size, v), scan, mib * 1000 / scan);
+    }
+}
+
+int main(void) {
+    static const char *cases[][2] = {
+        {"empty", ""},
+        {"no_newline", "text without a line break"},
+        {"only_newlines", "\n\n\r\n\r\r\n\n"},
+        {"crlf", "# Title\r\n\r\ntext\r\nmore text\r\n"},
+        {"cr", "# Title\r\rtext\rmore text\r"},
+        {"indented", "    code\n\tcode\n  \t text\n   > quote\n - item\n     nested\n"},
+        {"blank_indent", "a\n    \n\t\nb\n   \r\nc"},
+        {"fence", "```sh\necho a\n  echo b\n\techo c\n```\nafter\n"},
+        {"line_63", "012345678901234567890123456789012345678901234567890123456789012\nnext\n"},
+        {"line_64", "0123456789012345678901234567890123456789012345678901234567890123\nnext\n"},
+        {"line_65", "01234567890123456789012345678901234567890123456789012345678901234\nnext\n"},
+        {"crlf_split", "012345678901234567890123456789012345678901234567890123456789012\r\nnext\r\n"},
+        {"long_indent", "                                                                  deep\n"
+                        "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\tx\n"},
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        check(cases[i][0], cases[i][1], strlen(cases[i][1]));
+    }
+
+    // NUL bytes in a line
+    static const char nul[] = "abc\0def\n\0\n    \0code\n```\n\0\n```\n";
+    check("nul", nul, sizeof(nul) - 1);
+
+    for (unsigned seed = 1; seed <= 200; seed++) {
+        char name[32];
+        snprintf(name, sizeof(name), "random_%u", seed);
+        char *data = generate(seed * 53, seed);
+        check(name, data, strlen(data));
+        free(data);
+    }
+
+    char *code = generate_code(1 << 20);
+    check("fenced_code", code, strlen(code));
+    bench(code, strlen(code));
+    free(code);
+
+    if (failures) {
+        printf("FAIL %d\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("PASS\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,215 @@
+// Differential test of the vectorized mark scanning in md_collect_marks().
+// Inline markup of every kind is parsed with each dialect and each scan
+// variant the CPU supports against the scalar scan, and md_skip_to_mark() is
+// checked at every offset so marks at the edges of a vector are covered.
+//
+//     cc -O2 -o md4c_marks_test test/md4c_marks_test.c && ./md4c_marks_test
+
+#include "../md4c/md4c.c"
+#include "md4c_stream.h"
+
+static int parse(const char *data, size_t size, unsigned flags, int variant, STREAM *out) {
+    MD_PARSER parser = stream_parser(flags);
+    if (out) {
+        stream_reset(out);
+    }
+    md_simd_max = variant;
+    int ret     = md_parse(data, size, &parser, out);
+    md_simd_max = MD_SIMD_AVX2;
+    return ret;
+}
+
+static const unsigned flag_sets[] = {
+    0,
+    MD_DIALECT_GITHUB,
+    MD_DIALECT_GITHUB | MD_FLAG_COLLAPSEWHITESPACE | MD_FLAG_LATEXMATHSPANS | MD_FLAG_WIKILINKS,
+};
+
+static const char *variant_names[] = {"scalar", "sse2", "avx2"};
+
+// Highest variant the CPU supports
+static int max_variant(void) {
+    return md_simd_level();
+}
+
+static int failures = 0;
+
+static void check(const char *name, const char *data, size_t size) {
+    static STREAM expected, actual;
+    int           variants = max_variant();
+
+    for (size_t f = 0; f < sizeof(flag_sets) / sizeof(flag_sets[0]); f++) {
+        int ret = parse(data, size, flag_sets[f], MD_SIMD_SCALAR, &expected);
+        for (int v = MD_SIMD_SSE2; v <= variants; v++) {
+            int actual_ret = parse(data, size, flag_sets[f], v, &actual);
+            if (actual_ret != ret || actual.size != expected.size || memcmp(actual.data, expected.data, actual.size) != 0) {
+                printf("FAIL %s: %s differs from scalar with flags 0x%x\n", name, variant_names[v], flag_sets[f]);
+                failures++;
+            }
+        }
+    }
+}
+
+// Compare md_skip_to_mark() against the scalar loop for every start and end
+// offset, so marks at each position of a vector and right at its edges are
+// covered.
+static void check_offsets(const char *name, const char *data, size_t size) {
+    int variants = max_variant();
+
+    for (size_t f = 0; f < sizeof(flag_sets) / sizeof(flag_sets[0]); f++) {
+        MD_CTX ctx;
+        memset(&ctx, 0, sizeof(ctx));
+        ctx.text         = data;
+        ctx.size         = size;
+        ctx.parser.flags = flag_sets[f];
+        md_build_mark_char_map(&ctx);
+
+        for (OFF end = 0; end <= size; end++) {
+            for (OFF off = 0; off <= end; off++) {
+                OFF expected = md_skip_to_mark_scalar(&ctx, off, end);
+                for (int v = MD_SIMD_SSE2; v <= variants; v++) {
+                    ctx.simd = v;
+                    if (md_skip_to_mark(&ctx, off, end) != expected) {
+                        printf("FAIL %s: %s skips [%u, %u) to %u, scalar to %u\n", name, variant_names[v], (unsigned)off,
+                               (unsigned)end, (unsigned)md_skip_to_mark(&ctx, off, end), (unsigned)expected);
+                        failures++;
+                        return;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Text of len bytes drawn from alphabet, with lines of random length
+static char *generate(size_t len, const char *alphabet, unsigned seed) {
+    char  *data = malloc(len + 1);
+    size_t n    = strlen(alphabet);
+    srand(seed);
+    for (size_t i = 0; i < len; i++) {
+        data[i] = rand() % 40 == 0 ? '\n' : alphabet[rand() % n];
+    }
+    data[len] = '\0';
+    return data;
+}
+
+// Prose paragraphs with sparse inline markup
+static char *generate_prose(size_t len) {
+    static const char *words[] = {"the", "runbook", "deploys", "service", "to", "staging", "and", "checks",
+                                  "health", "of", "each", "node", "before", "traffic", "is", "shifted"};
+    static const char *markup[] = {"*note*", "`make`", "[docs](https://example.com)", "**must**", "&amp;"};
+    char              *data     = malloc(len + 64);
+    size_t             size     = 0;
+    srand(1);
+    while (size < len) {
+        const char *word = rand() % 24 == 0 ? markup[rand() % 5] : words[rand() % 16];
+        size += sprintf(data + size, "%s%s", word, rand() % 12 == 0 ? "\n" : " ");
+        if (rand() % 120 == 0) {
+            data[size++] = '\n';
+        }
+    }
+    data[size] = '\0';
+    return data;
+}
+
+static void bench_parse(const char *data, size_t size, int variant) {
+    parse(data, size, MD_DIALECT_GITHUB, variant, NULL);
+}
+
+// Marks bench_skip() visited, printed so the scan cannot be optimized out
+static volatile size_t mark_count;
+
+// Visit every mark of every line the way md_collect_marks() does
+static void bench_skip(const char *data, size_t size, int variant) {
+    MD_CTX ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.text         = data;
+    ctx.size         = size;
+    ctx.parser.flags = MD_DIALECT_GITHUB;
+    md_build_mark_char_map(&ctx);
+    ctx.simd = variant;
+
+    size_t count = 0;
+    OFF    beg   = 0;
+    while (beg < size) {
+        const char *eol = memchr(data + beg, '\n', size - beg);
+        OFF         end = eol ? (OFF)(eol - data) : (OFF)size;
+        for (OFF off = md_skip_to_mark(&ctx, beg, end); off < end; off = md_skip_to_mark(&ctx, off + 1, end)) {
+            count++;
+        }
+        beg = end + 1;
+    }
+    mark_count = count;
+}
+
+static void bench(const char *data, size_t size) {
+    int variants = max_variant();
+    printf("Prose, %zu KiB:\n", size / 1024);
+    for (int v = MD_SIMD_SCALAR; v <= variants; v++) {
+        double scan = best_of(bench_skip, data, size, v);
+        printf("  %-6s %6.2f ms parse, %6.2f ms mark scan (%zu marks)\n", variant_names[v],
+               best_of(bench_parse, data, size, v), scan, mark_count);
+    }
+}
+
+int main(void) {
+    static const char *cases[][2] = {
+        {"empty", ""},
+        {"plain", "The quick brown fox jumps over the lazy dog, again and again and again.\n"},
+        {"edges", "0123456789abcde*0123456789abcdef_0123456789abcdefghijklmnopqrstu`v`\n"},
+        {"last_byte", "0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcde*"},
+        {"emphasis", "*a* **b** _c_ __d__ ***e*** a_b_c snake_case_name\n"},
+        {"code_spans", "`a` ``b`` ```c``` `` ` `` unterminated ` span\n"},
+        {"links", "[a](b) ![c](d) <http://x.y> [ref] [ref]: /url\nfoo@bar.com www.example.com https://example.com.\n"},
+        {"entities", "&amp; &#123; &#x1F600; &bogus; & ; a;b\n"},
+        {"escapes", "\\* \\_ \\` \\\\ \\[ trailing backslash\\\nnext line\n"},
+        {"tables", "| a | b |\n|---|:-:|\n| `x|y` | ~~z~~ |\n"},
+        {"math", "$x$ $$y$$ $ not math $\n"},
+        {"wiki", "[[target|label]] [[plain]]\n"},
+        {"whitespace", "a \t b\v\fc  \t\t  d\r\ne\n"},
+        {"crlf", "line *one*\r\nline _two_\r\n\r\nline `three`\r\n"},
+        {"utf8", "caf\xC3\xA9 *\xC3\xBC* \xE2\x80\x9Cquoted\xE2\x80\x9D _\xF0\x9F\x98\x80_ \xC2\xA0*x*\n"},
+        {"high_bytes", "\x80\x81\xFE\xFF*\xAA\xBB\xCC\xDD\xEE\xFF\x80\x81\x82\x83\x84\x85\x86\x87\x88\x89_\xC0\n"},
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        check(cases[i][0], cases[i][1], strlen(cases[i][1]));
+        check_offsets(cases[i][0], cases[i][1], strlen(cases[i][1]));
+    }
+
+    // Embedded NUL bytes are marks too
+    static const char nul[] = "abc\0def *x*\0\0 0123456789abcdef0123456789\0abcdef\n";
+    check("nul", nul, sizeof(nul) - 1);
+    check_offsets("nul", nul, sizeof(nul) - 1);
+
+    static const char *alphabets[] = {
+        "abcdefghij \t",
+        "ab *_`\\&;<>[]!~$@:.|\t",
+        "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa*",
+        "\xC3\xA9\xE2\x80\x9C\x80\xFF abc_*",
+    };
+    for (size_t a = 0; a < sizeof(alphabets) / sizeof(alphabets[0]); a++) {
+        for (unsigned seed = 1; seed <= 50; seed++) {
+            char name[32];
+            snprintf(name, sizeof(name), "random_%zu_%u", a, seed);
+            char *data = generate(seed * 37, alphabets[a], seed);
+            check(name, data, strlen(data));
+            if (seed <= 5) {
+                check_offsets(name, data, strlen(data));
+            }
+            free(data);
+        }
+    }
+
+    char *prose = generate_prose(1 << 20);
+    check("prose", prose, strlen(prose));
+    bench(prose, strlen(prose));
+    free(prose);
+
+    if (failures) {
+        printf("FAIL %d\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("PASS\n");
+    return EXIT_SUCCESS;
+}
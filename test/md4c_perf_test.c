@@ -0,0 +1,375 @@
+// Guards md4c against inputs that make the parse time grow faster than the
+// input. Each case generates an adversarial document at doubling sizes,
+// times md_parse() on it and fits the growth exponent k of time ~ size^k
+// by least squares on the log-log points. It fails when k goes above
+// PERF_MAX_EXPONENT or when a single parse takes longer than
+// PERF_MAX_SECONDS, whatever the fit says.
+//
+//     cc -O2 -o /tmp/md4c_perf_test test/md4c_perf_test.c -lm && /tmp/md4c_perf_test [case...]
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../md4c/md4c.c"
+
+#define PERF_RUNS         3    // Best of, per size
+#define PERF_STEPS        4    // Sizes measured, each twice the previous
+#define PERF_MIN_SECONDS  2e-3 // Smallest size is grown until it takes this long
+#define PERF_MAX_BYTES    (4 << 20)
+#define PERF_MAX_SECONDS  2.0
+#define PERF_MAX_EXPONENT 1.35 // Linear is 1.0, quadratic 2.0; the rest is noise and caches
+
+typedef struct {
+    char  *data;
+    size_t size;
+    size_t capacity;
+} DOC;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void append(DOC *doc, const char *format, ...) {
+    char    line[256];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+
+    if (doc->size + len + 1 > doc->capacity) {
+        doc->capacity = (doc->size + len + 1) * 2;
+        doc->data     = realloc(doc->data, doc->capacity);
+        if (!doc->data) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    memcpy(doc->data + doc->size, line, len + 1);
+    doc->size += len;
+}
+
+static void repeat(DOC *doc, const char *text, int n) {
+    for (int i = 0; i < n; i++) {
+        append(doc, "%s", text);
+    }
+}
+
+// Generators, n is the number of repetitions of the adversarial pattern
+
+static void gen_nested_quotes(DOC *doc, int n) {
+    repeat(doc, ">", n);
+    append(doc, " a\n");
+}
+
+static void gen_nested_lists(DOC *doc, int n) {
+    repeat(doc, "- ", n);
+    append(doc, "a\n");
+}
+
+static void gen_nested_brackets(DOC *doc, int n) {
+    repeat(doc, "[", n);
+    append(doc, "a");
+    repeat(doc, "]", n);
+}
+
+static void gen_nested_emphasis(DOC *doc, int n) {
+    repeat(doc, "*a **a ", n);
+    append(doc, "b");
+    repeat(doc, " a** a*", n);
+}
+
+static void gen_unclosed_emphasis(DOC *doc, int n) {
+    repeat(doc, "*a _b **c __d ~~e ", n);
+}
+
+static void gen_unopened_emphasis(DOC *doc, int n) {
+    repeat(doc, "a* b_ c** d__ e~~ ", n);
+}
+
+static void gen_mod3_emphasis(DOC *doc, int n) {
+    repeat(doc, "a***b* ", n);
+}
+
+static void gen_backticks(DOC *doc, int n) {
+    for (int i = 0; i < n; i++) {
+        append(doc, "e%.*s", 1 + i % 40, "````````````````````````````````````````");
+    }
+}
+
+static void gen_unclosed_links(DOC *doc, int n) {
+    repeat(doc, "[a](b ", n);
+}
+
+static void gen_unclosed_link_dests(DOC *doc, int n) {
+    repeat(doc, "[a](<b ", n);
+}
+
+static void gen_link_label_chain(DOC *doc, int n) {
+    append(doc, "[x]: /url\n\n");
+    repeat(doc, "[a][x][", n);
+}
+
+static void gen_undefined_labels(DOC *doc, int n) {
+    repeat(doc, "[a][b] ", n);
+}
+
+static void gen_image_openers(DOC *doc, int n) {
+    repeat(doc, "![[]()", n);
+}
+
+static void gen_ref_defs(DOC *doc, int n) {
+    for (int i = 0; i < n; i++) {
+        append(doc, "[label %d]: /url/%d 'title %d'\n", i, i, i);
+    }
+    append(doc, "\n");
+    for (int i = 0; i < n; i++) {
+        append(doc, "[label %d] ", n - 1 - i);
+    }
+}
+
+static void gen_duplicate_ref_defs(DOC *doc, int n) {
+    repeat(doc, "[a]: /url\n", n);
+    append(doc, "\n[a]\n");
+}
+
+static void gen_ref_def_expansion(DOC *doc, int n) {
+    append(doc, "[a]: /%.*s\n\n", 200, "................................................................................................................................................................................................................");
+    repeat(doc, "[a]", n);
+}
+
+static void gen_wide_table(DOC *doc, int n) {
+    append(doc, "|");
+    repeat(doc, " a |", n);
+    append(doc, "\n|");
+    repeat(doc, "---|", n);
+    append(doc, "\n|");
+    repeat(doc, " `b` |", n);
+    append(doc, "\n");
+}
+
+static void gen_long_table(DOC *doc, int n) {
+    append(doc, "|");
+    repeat(doc, " a |", TABLE_MAXCOLCOUNT * 2);
+    append(doc, "\n|");
+    repeat(doc, "---|", TABLE_MAXCOLCOUNT * 2);
+    append(doc, "\n");
+    for (int i = 0; i < n; i++) {
+        append(doc, "| *b* | c | [d](e) |\n");
+    }
+}
+
+static void gen_table_pipes(DOC *doc, int n) {
+    append(doc, "| a |\n|---|\n");
+    repeat(doc, "|`|`", n);
+    append(doc, "\n");
+}
+
+static void gen_unclosed_html(DOC *doc, int n) {
+    repeat(doc, "a <!-- <? <![CDATA[ <!X <a b=\"", n);
+}
+
+static void gen_html_block_lines(DOC *doc, int n) {
+    repeat(doc, "<div>\n<a b='\n", n);
+}
+
+static void gen_entities(DOC *doc, int n) {
+    repeat(doc, "&#&#x&a&amp", n);
+}
+
+static void gen_autolinks(DOC *doc, int n) {
+    repeat(doc, "<a@b www.a http:// a@b.c ", n);
+}
+
+static void gen_math(DOC *doc, int n) {
+    repeat(doc, "$a $$b ", n);
+}
+
+static void gen_wikilinks(DOC *doc, int n) {
+    repeat(doc, "[[a|[[b ", n);
+}
+
+static void gen_lazy_lines(DOC *doc, int n) {
+    append(doc, "> - a\n");
+    repeat(doc, "b *c\n", n);
+}
+
+static void gen_fence_openers(DOC *doc, int n) {
+    for (int i = 0; i < n; i++) {
+        append(doc, "%.*s\na\n", 3 + i % 20, "~~~~~~~~~~~~~~~~~~~~~~~~");
+    }
+}
+
+typedef struct {
+    const char *name;
+    void (*generate)(DOC *doc, int n);
+} PERF_CASE;
+
+static const PERF_CASE cases[] = {
+    {"nested_quotes", gen_nested_quotes},
+    {"nested_lists", gen_nested_lists},
+    {"nested_brackets", gen_nested_brackets},
+    {"nested_emphasis", gen_nested_emphasis},
+    {"unclosed_emphasis", gen_unclosed_emphasis},
+    {"unopened_emphasis", gen_unopened_emphasis},
+    {"mod3_emphasis", gen_mod3_emphasis},
+    {"backticks", gen_backticks},
+    {"unclosed_links", gen_unclosed_links},
+    {"unclosed_link_dests", gen_unclosed_link_dests},
+    {"link_label_chain", gen_link_label_chain},
+    {"undefined_labels", gen_undefined_labels},
+    {"image_openers", gen_image_openers},
+    {"ref_defs", gen_ref_defs},
+    {"duplicate_ref_defs", gen_duplicate_ref_defs},
+    {"ref_def_expansion", gen_ref_def_expansion},
+    {"wide_table", gen_wide_table},
+    {"long_table", gen_long_table},
+    {"table_pipes", gen_table_pipes},
+    {"unclosed_html", gen_unclosed_html},
+    {"html_block_lines", gen_html_block_lines},
+    {"entities", gen_entities},
+    {"autolinks", gen_autolinks},
+    {"math", gen_math},
+    {"wikilinks", gen_wikilinks},
+    {"lazy_lines", gen_lazy_lines},
+    {"fence_openers", gen_fence_openers},
+};
+
+// The callbacks touch what they are given so nothing is optimized away
+static int enter_block(MD_BLOCKTYPE type, void *detail, void *userdata) {
+    (*(size_t *)userdata)++;
+    return 0;
+}
+
+static int leave_block(MD_BLOCKTYPE type, void *detail, void *userdata) {
+    (*(size_t *)userdata)++;
+    return 0;
+}
+
+static int enter_span(MD_SPANTYPE type, void *detail, void *userdata) {
+    (*(size_t *)userdata)++;
+    return 0;
+}
+
+static int leave_span(MD_SPANTYPE type, void *detail, void *userdata) {
+    (*(size_t *)userdata)++;
+    return 0;
+}
+
+static int text(MD_TEXTTYPE type, const MD_CHAR *data, MD_SIZE size, void *userdata) {
+    *(size_t *)userdata += size;
+    return 0;
+}
+
+static const MD_PARSER parser = {
+    .abi_version = 0,
+    .flags       = MD_DIALECT_GITHUB | MD_FLAG_LATEXMATHSPANS | MD_FLAG_WIKILINKS,
+    .enter_block = enter_block,
+    .leave_block = leave_block,
+    .enter_span  = enter_span,
+    .leave_span  = leave_span,
+    .text        = text,
+};
+
+// Best time of PERF_RUNS parses, or the first one when it is over the limit
+static double time_parse(const DOC *doc) {
+    double best = 0;
+    for (int run = 0; run < PERF_RUNS; run++) {
+        size_t count = 0;
+        double start = now();
+        md_parse(doc->data, (MD_SIZE)doc->size, &parser, &count);
+        double elapsed = now() - start;
+        if (run == 0 || elapsed < best) {
+            best = elapsed;
+        }
+        if (elapsed > PERF_MAX_SECONDS) {
+            break;
+        }
+    }
+    return best;
+}
+
+static double time_case(const PERF_CASE *c, int n, size_t *size) {
+    DOC doc = {0};
+    c->generate(&doc, n);
+    double elapsed = time_parse(&doc);
+    *size          = doc.size;
+    free(doc.data);
+    return elapsed;
+}
+
+// Slope of the least squares line through (log size, log time)
+static double fit_exponent(const double *sizes, const double *times, int count) {
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (int i = 0; i < count; i++) {
+        double x = log(sizes[i]), y = log(times[i]);
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+    return (count * sxy - sx * sy) / (count * sxx - sx * sx);
+}
+
+static int run_case(const PERF_CASE *c) {
+    double sizes[PERF_STEPS], times[PERF_STEPS];
+    size_t size = 0;
+    int    n    = 64;
+
+    // Grow the smallest size until it is measurable, so noise does not
+    // dominate the fit
+    double elapsed = time_case(c, n, &size);
+    while (elapsed < PERF_MIN_SECONDS && size < PERF_MAX_BYTES >> PERF_STEPS) {
+        n *= 2;
+        elapsed = time_case(c, n, &size);
+    }
+
+    int steps = 0;
+    for (; steps < PERF_STEPS; steps++, n *= 2) {
+        if (steps > 0) {
+            elapsed = time_case(c, n, &size);
+        }
+        sizes[steps] = size;
+        times[steps] = elapsed > 1e-7 ? elapsed : 1e-7;
+        if (elapsed > PERF_MAX_SECONDS) {
+            printf("%-20s %9zu bytes took %.3f s\n", c->name, size, elapsed);
+            printf("%-20s FAIL (over %.1f s)\n", c->name, PERF_MAX_SECONDS);
+            return 0;
+        }
+    }
+
+    double exponent = fit_exponent(sizes, times, steps);
+    printf("%-20s %9.0f .. %9.0f bytes  %8.3f .. %8.3f ms  %6.2f ns/byte  exponent %.2f\n", c->name, sizes[0],
+           sizes[steps - 1], times[0] * 1e3, times[steps - 1] * 1e3, times[steps - 1] * 1e9 / sizes[steps - 1],
+           exponent);
+    if (exponent > PERF_MAX_EXPONENT) {
+        printf("%-20s FAIL (superlinear, over %.2f)\n", c->name, PERF_MAX_EXPONENT);
+        return 0;
+    }
+    printf("%-20s PASS\n", c->name);
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    int ok = 1, ran = 0;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        int selected = argc < 2;
+        for (int arg = 1; arg < argc; arg++) {
+            selected |= strcmp(argv[arg], cases[i].name) == 0;
+        }
+        if (selected) {
+            ok &= run_case(&cases[i]);
+            ran++;
+        }
+    }
+    if (ran == 0) {
+        fprintf(stderr, "No such case\n");
+        return EXIT_FAILURE;
+    }
+    printf(ok ? "PASS\n" : "FAIL\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
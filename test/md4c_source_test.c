@@ -0,0 +1,324 @@
+// Test of the source positions md4c reports through MD_PARSER::block_source.
+// Known documents are checked against the expected text of each block, and
+// generated ones against the invariants every block has to satisfy.
+//
+//     cc -O2 -o md4c_source_test test/md4c_source_test.c && ./md4c_source_test
+
+#include "../md4c/md4c.c"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_BLOCKS 4096
+#define MAX_DEPTH  64
+
+typedef struct {
+    MD_BLOCKTYPE    type;
+    MD_BLOCK_SOURCE source;
+} BLOCK;
+
+typedef struct {
+    const char *text;
+    size_t      size;
+    BLOCK       blocks[MAX_BLOCKS];
+    int         count;
+    int         with_source;
+    int         pending; // block_source was called, enter_block not yet
+    int         stack[MAX_DEPTH];
+    int         depth;
+    int         errors;
+    unsigned    hash; // Of all other callbacks, to compare with a parse without block_source
+} RUN;
+
+static const char *name;
+static int         failures = 0;
+
+static void fail(RUN *run, const char *format, int block) {
+    if (block < 0) {
+        printf("FAIL %s: %s before any block\n", name, format);
+        failures++;
+    } else if (run->errors++ == 0) {
+        BLOCK *b = &run->blocks[block];
+        printf("FAIL %s: block %d (type %d, block [%u, %u) lines %u-%u, content [%u, %u) lines %u-%u): %s\n", name,
+               block, b->type, b->source.block.beg, b->source.block.end, b->source.block.beg_line,
+               b->source.block.end_line, b->source.content.beg, b->source.content.end, b->source.content.beg_line,
+               b->source.content.end_line, format);
+        failures++;
+    }
+}
+
+static void hash(RUN *run, int kind, int type) {
+    run->hash = (run->hash ^ (unsigned)(kind * 64 + type)) * 16777619u;
+}
+
+static int block_source(MD_BLOCKTYPE type, const MD_BLOCK_SOURCE *source, void *userdata) {
+    RUN *run = userdata;
+    if (run->pending) {
+        fail(run, "block_source called twice", run->count - 1);
+    }
+    if (run->count < MAX_BLOCKS) {
+        run->blocks[run->count].type   = type;
+        run->blocks[run->count].source = *source;
+        run->count++;
+    }
+    run->pending = 1;
+    return 0;
+}
+
+static int enter_block(MD_BLOCKTYPE type, void *detail, void *userdata) {
+    RUN *run = userdata;
+    hash(run, 1, type);
+    if (!run->with_source) {
+        return 0;
+    }
+    if (!run->pending || run->blocks[run->count - 1].type != type) {
+        fail(run, "enter_block without block_source", run->count - 1);
+    }
+    run->pending = 0;
+
+    // Every block lies within the block it is nested in
+    if (run->depth > 0 && run->depth <= MAX_DEPTH) {
+        const MD_SOURCE_RANGE *parent = &run->blocks[run->stack[run->depth - 1]].source.block;
+        const MD_SOURCE_RANGE *child  = &run->blocks[run->count - 1].source.block;
+        if (child->beg < parent->beg || child->end > parent->end) {
+            fail(run, "block outside of its parent", run->count - 1);
+        }
+    }
+    if (run->depth < MAX_DEPTH) {
+        run->stack[run->depth] = run->count - 1;
+    }
+    run->depth++;
+    return 0;
+}
+
+static int leave_block(MD_BLOCKTYPE type, void *detail, void *userdata) {
+    RUN *run = userdata;
+    hash(run, 2, type);
+    if (run->with_source) {
+        run->depth--;
+    }
+    return 0;
+}
+
+static int enter_span(MD_SPANTYPE type, void *detail, void *userdata) {
+    hash(userdata, 3, type);
+    return 0;
+}
+
+static int leave_span(MD_SPANTYPE type, void *detail, void *userdata) {
+    hash(userdata, 4, type);
+    return 0;
+}
+
+static int text(MD_TEXTTYPE type, const MD_CHAR *data, MD_SIZE size, void *userdata) {
+    RUN *run = userdata;
+    hash(run, 5, type);
+    for (MD_SIZE i = 0; i < size; i++) {
+        run->hash = (run->hash ^ (unsigned char)data[i]) * 16777619u;
+    }
+    return 0;
+}
+
+static void parse(RUN *run, const char *data, size_t size, int with_source) {
+    MD_PARSER parser   = {0};
+    parser.abi_version = MD_PARSER_ABI_SOURCE;
+    parser.flags       = MD_DIALECT_GITHUB;
+    parser.enter_block = enter_block;
+    parser.leave_block = leave_block;
+    parser.enter_span  = enter_span;
+    parser.leave_span  = leave_span;
+    parser.text        = text;
+    if (with_source) {
+        parser.block_source = block_source;
+    }
+
+    memset(run, 0, sizeof(*run));
+    run->text = data;
+    run->size = size;
+    run->hash        = 2166136261u;
+    run->with_source = with_source;
+    md_parse(data, size, &parser, run);
+}
+
+// Line of off, counted the slow way
+static unsigned line_of(const char *data, size_t size, size_t off) {
+    unsigned line = 1;
+    for (size_t i = 0; i < off && i < size; i++) {
+        if (data[i] == '\n' || (data[i] == '\r' && (i + 1 >= size || data[i + 1] != '\n'))) {
+            line++;
+        }
+    }
+    return line;
+}
+
+static int is_newline(char ch) {
+    return ch == '\n' || ch == '\r';
+}
+
+static void check_range(RUN *run, int block, const MD_SOURCE_RANGE *range, const char *what) {
+    if (range->beg > range->end || range->end > run->size) {
+        fail(run, what, block);
+        return;
+    }
+    unsigned end_line = range->end > range->beg ? line_of(run->text, run->size, range->end - 1) : 0;
+    if (range->beg_line != line_of(run->text, run->size, range->beg) ||
+        range->end_line != (range->end > range->beg ? end_line : range->beg_line)) {
+        fail(run, "wrong line numbers", block);
+    }
+}
+
+// What every block has to satisfy
+static void check_invariants(RUN *run) {
+    for (int i = 0; i < run->count; i++) {
+        const MD_BLOCK_SOURCE *s = &run->blocks[i].source;
+        check_range(run, i, &s->block, "bad block range");
+        check_range(run, i, &s->content, "bad content range");
+
+        if (s->content.beg < s->block.beg || s->content.end > s->block.end) {
+            fail(run, "content outside of the block", i);
+        }
+        if (s->block.beg > 0 && !is_newline(run->text[s->block.beg - 1])) {
+            fail(run, "block does not start a line", i);
+        }
+        if (s->block.end < run->size && !is_newline(run->text[s->block.end])) {
+            fail(run, "block does not end a line", i);
+        }
+        if (i > 0 && s->block.beg < run->blocks[i - 1].source.block.beg) {
+            fail(run, "blocks out of order", i);
+        }
+    }
+}
+
+typedef struct {
+    MD_BLOCKTYPE type;
+    const char  *block;   // Expected source text
+    const char  *content;
+} EXPECT;
+
+static void check_expected(const char *case_name, const char *data, const EXPECT *expect, int n) {
+    static RUN run;
+    name = case_name;
+    parse(&run, data, strlen(data), 1);
+
+    if (run.count != n) {
+        printf("FAIL %s: %d blocks, expected %d\n", name, run.count, n);
+        failures++;
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        const MD_BLOCK_SOURCE *s     = &run.blocks[i].source;
+        size_t                 bsize = s->block.end - s->block.beg;
+        size_t                 csize = s->content.end - s->content.beg;
+        if (run.blocks[i].type != expect[i].type || bsize != strlen(expect[i].block) ||
+            memcmp(data + s->block.beg, expect[i].block, bsize) != 0 || csize != strlen(expect[i].content) ||
+            memcmp(data + s->content.beg, expect[i].content, csize) != 0) {
+            printf("FAIL %s: block %d is type %d \"%.*s\" / \"%.*s\", expected type %d \"%s\" / \"%s\"\n", name, i,
+                   run.blocks[i].type, (int)bsize, data + s->block.beg, (int)csize, data + s->content.beg,
+                   expect[i].type, expect[i].block, expect[i].content);
+            failures++;
+        }
+    }
+    check_invariants(&run);
+}
+
+// Parse with and without block_source, the other callbacks must not change
+static void check_generated(const char *case_name, const char *data, size_t size) {
+    static RUN with, without;
+    name = case_name;
+    parse(&with, data, size, 1);
+    parse(&without, data, size, 0);
+    if (with.hash != without.hash) {
+        printf("FAIL %s: callbacks differ with block_source\n", name);
+        failures++;
+    }
+    check_invariants(&with);
+}
+
+// Lines of markdown constructs, nested at random
+static char *generate(unsigned seed) {
+    static const char *prefixes[] = {"", "", "> ", "- ", "1. ", "  ", "    ", "- [x] ", "> > ", "* "};
+    static const char *lines[]    = {
+        "text *with* _marks_", "# Heading", "## Heading ##", "```sh", "```", "~~~", "code", "",
+        "| a | b |",           "|---|---|", "| 1 | 2 |",     "---",   "<div>", "</div>", "Setext",
+        "===",                 "[ref]: /url", "\t\tindented", "text\r",
+    };
+    char  *data = malloc(64 * 1024);
+    size_t size = 0;
+    srand(seed);
+    int count = rand() % 60;
+    for (int i = 0; i < count; i++) {
+        size += sprintf(data + size, "%s%s%s", prefixes[rand() % 10], lines[rand() % 19], rand() % 8 ? "\n" : "\r\n");
+    }
+    data[size] = '\0';
+    return data;
+}
+
+int main(void) {
+    static const EXPECT heading[] = {
+        {MD_BLOCK_DOC, "# Title\n\nSome *text*\nmore  \n", "# Title\n\nSome *text*\nmore  \n"},
+        {MD_BLOCK_H, "# Title", "Title"},
+        {MD_BLOCK_P, "Some *text*\nmore  ", "Some *text*\nmore"},
+    };
+    check_expected("heading", "# Title\n\nSome *text*\nmore  \n", heading, 3);
+
+    static const EXPECT code[] = {
+        {MD_BLOCK_DOC, "Intro\r\n\r\n```sh\r\necho a\r\necho b\r\n```\r\n\r\n```\r\n```", "Intro\r\n\r\n```sh\r\necho a\r\necho b\r\n```\r\n\r\n```\r\n```"},
+        {MD_BLOCK_P, "Intro", "Intro"},
+        {MD_BLOCK_CODE, "```sh\r\necho a\r\necho b\r\n```", "echo a\r\necho b"},
+        {MD_BLOCK_CODE, "```\r\n```", ""},
+    };
+    check_expected("code", "Intro\r\n\r\n```sh\r\necho a\r\necho b\r\n```\r\n\r\n```\r\n```", code, 4);
+
+    static const EXPECT unclosed[] = {
+        {MD_BLOCK_DOC, "~~~\ncode\n\n", "~~~\ncode\n\n"},
+        {MD_BLOCK_CODE, "~~~\ncode\n", "code\n"},
+    };
+    check_expected("unclosed", "~~~\ncode\n\n", unclosed, 2);
+
+    static const EXPECT lists[] = {
+        {MD_BLOCK_DOC, "> - one\n>   two\n> - [x] task\n\nafter", "> - one\n>   two\n> - [x] task\n\nafter"},
+        {MD_BLOCK_QUOTE, "> - one\n>   two\n> - [x] task", "one\n>   two\n> - [x] task"},
+        {MD_BLOCK_UL, "> - one\n>   two\n> - [x] task", "one\n>   two\n> - [x] task"},
+        {MD_BLOCK_LI, "> - one\n>   two", "one\n>   two"},
+        {MD_BLOCK_LI, "> - [x] task", "task"},
+        {MD_BLOCK_P, "after", "after"},
+    };
+    check_expected("lists", "> - one\n>   two\n> - [x] task\n\nafter", lists, 6);
+
+    static const EXPECT table[] = {
+        {MD_BLOCK_DOC, "| key | value |\n|-----|-------|\n| A   | `1` |\n| B |\n", "| key | value |\n|-----|-------|\n| A   | `1` |\n| B |\n"},
+        {MD_BLOCK_TABLE, "| key | value |\n|-----|-------|\n| A   | `1` |\n| B |", "| key | value |\n|-----|-------|\n| A   | `1` |\n| B |"},
+        {MD_BLOCK_THEAD, "| key | value |\n|-----|-------|", "| key | value |"},
+        {MD_BLOCK_TR, "| key | value |", "| key | value |"},
+        {MD_BLOCK_TH, "| key | value |", "key"},
+        {MD_BLOCK_TH, "| key | value |", "value"},
+        {MD_BLOCK_TBODY, "| A   | `1` |\n| B |", "| A   | `1` |\n| B |"},
+        {MD_BLOCK_TR, "| A   | `1` |", "| A   | `1` |"},
+        {MD_BLOCK_TD, "| A   | `1` |", "A"},
+        {MD_BLOCK_TD, "| A   | `1` |", "`1`"},
+        {MD_BLOCK_TR, "| B |", "| B |"},
+        {MD_BLOCK_TD, "| B |", "B"},
+        {MD_BLOCK_TD, "| B |", ""},
+    };
+    check_expected("table", "| key | value |\n|-----|-------|\n| A   | `1` |\n| B |\n", table, 13);
+
+    static const EXPECT empty[] = {
+        {MD_BLOCK_DOC, "", ""},
+    };
+    check_expected("empty", "", empty, 1);
+
+    for (unsigned seed = 1; seed <= 2000; seed++) {
+        char case_name[32];
+        snprintf(case_name, sizeof(case_name), "random_%u", seed);
+        char *data = generate(seed);
+        check_generated(case_name, data, strlen(data));
+        free(data);
+    }
+
+    if (failures) {
+        printf("FAIL %d\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("PASS\n");
+    return EXIT_SUCCESS;
+}
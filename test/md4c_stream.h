@@ -0,0 +1,220 @@
+// Recorder shared by the md4c differential tests. The parser callbacks below
+// append every event to a STREAM as text, with the block and span details
+// and the source ranges, so the output of two parses compares byte for byte
+// with memcmp(). Also the timing helpers of the tests which report speeds.
+//
+// Include after md4c.c.
+#ifndef MD4C_STREAM_H
+#define MD4C_STREAM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct {
+    char  *data;
+    size_t size;
+    size_t capacity;
+    int    blocks;   // enter_block calls so far
+    int    events;   // Callbacks so far
+    int    abort_at; // Callback returning STREAM_ABORT, or 0
+} STREAM;
+
+#define STREAM_ABORT (-7)
+
+// A NULL stream discards the events, for timing the parser alone
+static inline void stream_append(STREAM *s, const void *data, size_t size) {
+    if (!s) {
+        return;
+    }
+    if (s->size + size > s->capacity) {
+        s->capacity = (s->size + size) * 2;
+        s->data     = realloc(s->data, s->capacity);
+        if (!s->data) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    memcpy(s->data + s->size, data, size);
+    s->size += size;
+}
+
+// Forget the recorded events but keep the memory
+static inline void stream_reset(STREAM *s) {
+    s->size   = 0;
+    s->blocks = 0;
+    s->events = 0;
+}
+
+static inline int stream_event(STREAM *s, char kind, int type) {
+    if (!s) {
+        return 0;
+    }
+    char buf[16];
+    int  n = snprintf(buf, sizeof(buf), "%c%d:", kind, type);
+    stream_append(s, buf, n);
+    return ++s->events == s->abort_at ? STREAM_ABORT : 0;
+}
+
+static inline void stream_attribute(STREAM *s, const MD_ATTRIBUTE *attr) {
+    if (!attr->text) {
+        stream_append(s, "(null)", 6);
+        return;
+    }
+    stream_append(s, "\"", 1);
+    stream_append(s, attr->text, attr->size);
+    for (int i = 0; attr->substr_offsets[i] < attr->size; i++) {
+        char buf[32];
+        int  n = snprintf(buf, sizeof(buf), "|%d@%u", attr->substr_types[i], attr->substr_offsets[i]);
+        stream_append(s, buf, n);
+    }
+    stream_append(s, "\"", 1);
+}
+
+static inline void stream_block_detail(STREAM *s, MD_BLOCKTYPE type, void *detail) {
+    if (!s) {
+        return;
+    }
+    char buf[64];
+    int  n = 0;
+    switch (type) {
+        case MD_BLOCK_H:
+            n = snprintf(buf, sizeof(buf), "level=%u", ((MD_BLOCK_H_DETAIL *)detail)->level);
+            break;
+        case MD_BLOCK_CODE: {
+            MD_BLOCK_CODE_DETAIL *code = detail;
+            stream_attribute(s, &code->info);
+            stream_attribute(s, &code->lang);
+            n = snprintf(buf, sizeof(buf), "fence=%d", code->fence_char);
+            break;
+        }
+        case MD_BLOCK_TABLE: {
+            MD_BLOCK_TABLE_DETAIL *table = detail;
+            n = snprintf(buf, sizeof(buf), "cols=%u,%u,%u", table->col_count, table->head_row_count,
+                         table->body_row_count);
+            break;
+        }
+        case MD_BLOCK_TH:
+        case MD_BLOCK_TD:
+            n = snprintf(buf, sizeof(buf), "align=%d", ((MD_BLOCK_TD_DETAIL *)detail)->align);
+            break;
+        case MD_BLOCK_UL: {
+            MD_BLOCK_UL_DETAIL *ul = detail;
+            n = snprintf(buf, sizeof(buf), "tight=%d,%c", ul->is_tight, ul->mark);
+            break;
+        }
+        case MD_BLOCK_LI: {
+            MD_BLOCK_LI_DETAIL *li = detail;
+            n = snprintf(buf, sizeof(buf), "task=%d,%u", li->is_task, li->is_task ? li->task_mark_offset : 0);
+            break;
+        }
+        default:
+            break;
+    }
+    stream_append(s, buf, n);
+}
+
+static inline void stream_span_detail(STREAM *s, MD_SPANTYPE type, void *detail) {
+    if (!s) {
+        return;
+    }
+    switch (type) {
+        case MD_SPAN_A: {
+            MD_SPAN_A_DETAIL *a = detail;
+            stream_attribute(s, &a->href);
+            stream_attribute(s, &a->title);
+            stream_append(s, a->is_autolink ? "auto" : "", a->is_autolink ? 4 : 0);
+            break;
+        }
+        case MD_SPAN_IMG: {
+            MD_SPAN_IMG_DETAIL *img = detail;
+            stream_attribute(s, &img->src);
+            stream_attribute(s, &img->title);
+            break;
+        }
+        case MD_SPAN_WIKILINK:
+            stream_attribute(s, &((MD_SPAN_WIKILINK_DETAIL *)detail)->target);
+            break;
+        default:
+            break;
+    }
+}
+
+static inline int stream_enter_block(MD_BLOCKTYPE type, void *detail, void *userdata) {
+    STREAM *s = userdata;
+    if (s) {
+        s->blocks++;
+    }
+    stream_block_detail(s, type, detail);
+    return stream_event(s, 'B', type);
+}
+
+static inline int stream_leave_block(MD_BLOCKTYPE type, void *detail, void *userdata) {
+    stream_block_detail(userdata, type, detail);
+    return stream_event(userdata, 'b', type);
+}
+
+static inline int stream_enter_span(MD_SPANTYPE type, void *detail, void *userdata) {
+    stream_span_detail(userdata, type, detail);
+    return stream_event(userdata, 'S', type);
+}
+
+static inline int stream_leave_span(MD_SPANTYPE type, void *detail, void *userdata) {
+    stream_span_detail(userdata, type, detail);
+    return stream_event(userdata, 's', type);
+}
+
+static inline int stream_text(MD_TEXTTYPE type, const MD_CHAR *data, MD_SIZE size, void *userdata) {
+    stream_append(userdata, data, size);
+    stream_append(userdata, "\n", 1);
+    return stream_event(userdata, 'T', type);
+}
+
+// Needs MD_PARSER_ABI_SOURCE or later
+static inline int stream_block_source(MD_BLOCKTYPE type, const MD_BLOCK_SOURCE *source, void *userdata) {
+    if (!userdata) {
+        return 0;
+    }
+    char buf[96];
+    int  n = snprintf(buf, sizeof(buf), "R%u-%u:%u-%u:%u-%u:%u-%u:", source->block.beg, source->block.end,
+                      source->block.beg_line, source->block.end_line, source->content.beg, source->content.end,
+                      source->content.beg_line, source->content.end_line);
+    stream_append(userdata, buf, n);
+    return stream_event(userdata, 'R', type);
+}
+
+// Parser recording into the STREAM passed as userdata. The ABI and the
+// other callbacks are left to the test.
+static inline MD_PARSER stream_parser(unsigned flags) {
+    MD_PARSER parser   = {0};
+    parser.flags       = flags;
+    parser.enter_block = stream_enter_block;
+    parser.leave_block = stream_leave_block;
+    parser.enter_span  = stream_enter_span;
+    parser.leave_span  = stream_leave_span;
+    parser.text        = stream_text;
+    return parser;
+}
+
+static inline double seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Best of 20 runs of fn, in milliseconds
+static inline double best_of(void (*fn)(const char *, size_t, int), const char *data, size_t size, int variant) {
+    double best = 0;
+    for (int i = 0; i < 20; i++) {
+        double start = seconds();
+        fn(data, size, variant);
+        double elapsed = seconds() - start;
+        if (i == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    return best * 1000;
+}
+
+#endif
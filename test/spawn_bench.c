@@ -0,0 +1,138 @@
+// Per-block spawn latency of the ways execute_node() can start a code block:
+// fork() and execvp() as it used to, posix_spawnp() searching PATH on each
+// call, and posix_spawn() of a path resolved once as it does now. Each is
+// timed with a small and with a large heap touched in the parent, the way
+// cr holds a parsed document, since fork() copies the page tables of all of
+// it while posix_spawn() shares the memory until the exec.
+//
+// It fails when posix_spawn() of the resolved path is slower than fork()
+// and execvp() with the large heap.
+//
+//     cc -O2 -o /tmp/spawn_bench test/spawn_bench.c && /tmp/spawn_bench
+#include <errno.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_SPAWNS    300
+#define BENCH_HEAP_SMALL (1 << 20)
+#define BENCH_HEAP_LARGE (256 << 20)
+
+extern char **environ;
+
+static char *const program_args[] = {"true", NULL};
+static char        program_path[4096];
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int wait_child(pid_t pid) {
+    int status;
+    while (waitpid(pid, &status, 0) == -1) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+static int spawn_fork(void) {
+    pid_t pid = fork();
+    if (pid == -1) {
+        return -1;
+    }
+    if (pid == 0) {
+        execvp(program_args[0], program_args);
+        _exit(127);
+    }
+    return wait_child(pid);
+}
+
+static int spawn_spawnp(void) {
+    pid_t pid;
+    if (posix_spawnp(&pid, program_args[0], NULL, NULL, program_args, environ) != 0) {
+        return -1;
+    }
+    return wait_child(pid);
+}
+
+static int spawn_resolved(void) {
+    pid_t pid;
+    if (posix_spawn(&pid, program_path, NULL, NULL, program_args, environ) != 0) {
+        return -1;
+    }
+    return wait_child(pid);
+}
+
+// Find the program in PATH once, like execute_node() does
+static int resolve(const char *name) {
+    const char *path = getenv("PATH");
+    while (path && *path) {
+        size_t len = strcspn(path, ":");
+        snprintf(program_path, sizeof(program_path), "%.*s/%s", (int)len, len ? path : ".", name);
+        if (access(program_path, X_OK) == 0) {
+            return 0;
+        }
+        path += len + (path[len] == ':');
+    }
+    return -1;
+}
+
+// Microseconds per spawn, -1 on a failed spawn
+static double bench(int (*spawn)(void)) {
+    double start = now();
+    for (int i = 0; i < BENCH_SPAWNS; i++) {
+        if (spawn() != 0) {
+            return -1;
+        }
+    }
+    return (now() - start) * 1e6 / BENCH_SPAWNS;
+}
+
+int main() {
+    if (resolve(program_args[0]) != 0) {
+        printf("Cannot find %s in PATH\n", program_args[0]);
+        return EXIT_FAILURE;
+    }
+
+    static const size_t heaps[] = {BENCH_HEAP_SMALL, BENCH_HEAP_LARGE};
+    double              fork_large = 0, resolved_large = 0;
+    for (int h = 0; h < 2; h++) {
+        // Touch every page, so it is mapped and its page table entries exist
+        char *heap = malloc(heaps[h]);
+        if (!heap) {
+            printf("Cannot allocate %zu MiB\n", heaps[h] >> 20);
+            return EXIT_FAILURE;
+        }
+        memset(heap, 1, heaps[h]);
+
+        double fork_us     = bench(spawn_fork);
+        double spawnp_us   = bench(spawn_spawnp);
+        double resolved_us = bench(spawn_resolved);
+        if (fork_us < 0 || spawnp_us < 0 || resolved_us < 0) {
+            printf("Spawning %s failed\n", program_args[0]);
+            return EXIT_FAILURE;
+        }
+        printf("heap %4zu MiB  fork+execvp %8.1f us  posix_spawnp %8.1f us  posix_spawn %8.1f us  (x%.2f faster)\n",
+               heaps[h] >> 20, fork_us, spawnp_us, resolved_us, fork_us / resolved_us);
+        if (heaps[h] == BENCH_HEAP_LARGE) {
+            fork_large     = fork_us;
+            resolved_large = resolved_us;
+        }
+        free(heap);
+    }
+
+    if (resolved_large > fork_large) {
+        printf("FAIL\n");
+        return EXIT_FAILURE;
+    }
+    printf("PASS\n");
+    return EXIT_SUCCESS;
+}
@@ -14,6 +14,53 @@ void *safe_malloc(size_t size) {
     return ptr;
 }
 
+void *safe_calloc(size_t count, size_t size) {
+    void *ptr = calloc(count, size);
+    if (!ptr) {
+        error("Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+void *safe_realloc(void *ptr, size_t size) {
+    void *new_ptr = realloc(ptr, size);
+    if (!new_ptr) {
+        error("Error: Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    return new_ptr;
+}
+
+void buffer_append(BUFFER *buffer, const char *data, size_t size) {
+    if (buffer->size + size + 1 > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity : 256;
+        while (buffer->size + size + 1 > capacity) {
+            capacity *= 2;
+        }
+        buffer->data     = safe_realloc(buffer->data, capacity);
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+    buffer->data[buffer->size] = '\0';
+}
+
+// Empty the buffer but keep its memory for reuse
+void buffer_reset(BUFFER *buffer) {
+    buffer->size = 0;
+    if (buffer->data) {
+        buffer->data[0] = '\0';
+    }
+}
+
+void buffer_free(BUFFER *buffer) {
+    free(buffer->data);
+    buffer->data     = NULL;
+    buffer->size     = 0;
+    buffer->capacity = 0;
+}
+
 char *strlower(char *str) {
     char *lower = strdup(str);
     for (int i = 0; lower[i]; i++) {
@@ -3,7 +3,20 @@
 
 #include <stddef.h>
 
+// Growable byte buffer, kept NUL-terminated
+typedef struct BUFFER BUFFER;
+struct BUFFER {
+    char  *data;
+    size_t size;
+    size_t capacity;
+};
+
 char *strlower(char *str);
 void *safe_malloc(size_t size);
+void *safe_calloc(size_t count, size_t size);
+void *safe_realloc(void *ptr, size_t size);
+void  buffer_append(BUFFER *buffer, const char *data, size_t size);
+void  buffer_reset(BUFFER *buffer);
+void  buffer_free(BUFFER *buffer);
 
 #endif
\ No newline at end of file